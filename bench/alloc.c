@@ -0,0 +1,149 @@
+// heap allocations and time of building and inverting the precode matrix,
+// and of nanorq_repair_block. links with --wrap for malloc, calloc, realloc
+// and posix_memalign, see the Makefile, so only calls made by the library
+// and this file are counted
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "nanorq.h"
+#include "precode.h"
+
+#define RUNS 5
+#define T 64
+
+static size_t allocs;
+static bool counting;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+int __real_posix_memalign(void **ptr, size_t align, size_t size);
+
+void *__wrap_malloc(size_t size) {
+  allocs += counting;
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size) {
+  allocs += counting;
+  return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+  allocs += counting;
+  return __real_realloc(ptr, size);
+}
+
+int __wrap_posix_memalign(void **ptr, size_t align, size_t size) {
+  allocs += counting;
+  return __real_posix_memalign(ptr, align, size);
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void count_start(double *t) {
+  allocs = 0;
+  counting = true;
+  *t = now();
+}
+
+static double count_stop(double t) {
+  counting = false;
+  return now() - t;
+}
+
+// encoder matrix of K, best of RUNS. invert counts include the transpose,
+// the inactivation buckets, the schedule and freeing A
+static void precode(uint16_t K) {
+  params P = params_init(K);
+  size_t gen_allocs = 0, inv_allocs = 0;
+  double gen_best = 1e9, inv_best = 1e9, t;
+  for (int run = 0; run < RUNS; run++) {
+    count_start(&t);
+    spmat *A = precode_matrix_gen(&P, NULL, 0, NULL);
+    t = count_stop(t);
+    gen_allocs = allocs;
+    if (t < gen_best)
+      gen_best = t;
+
+    count_start(&t);
+    schedule *S = precode_matrix_invert(&P, A, PRECODE_FAST);
+    t = count_stop(t);
+    inv_allocs = allocs;
+    if (t < inv_best)
+      inv_best = t;
+    sched_free(S);
+  }
+  printf("%6u %11zu %10.2f ms %11zu %10.2f ms\n", K, gen_allocs, gen_best * 1e3,
+         inv_allocs, inv_best * 1e3);
+}
+
+// one block of K with 30% loss and two symbols of overhead, inverted by
+// nanorq_repair_block rather than decoded on arrival
+static bool repair(uint16_t K, bool full_inactivation) {
+  size_t len = (size_t)K * T;
+  uint8_t *src = malloc(len), *dst = calloc(1, len);
+  for (size_t i = 0; i < len; i++)
+    src[i] = rand();
+  struct ioctx *in = ioctx_from_mem(src, len);
+  struct ioctx *out = ioctx_from_mem(dst, len);
+  nanorq *enc = nanorq_encoder_new_ex(len, T, K, 1, 1);
+  nanorq_set_max_esi(enc, 65535);
+  nanorq_generate_all_symbols(enc, in, 1);
+  nanorq *dec = nanorq_decoder_new(nanorq_oti_common(enc),
+                                   nanorq_oti_scheme_specific(enc));
+  nanorq_set_max_esi(dec, 65535);
+  nanorq_set_incremental_max(dec, 0);
+  nanorq_set_full_inactivation(dec, full_inactivation);
+
+  uint8_t sym[T];
+  size_t got = 0, need = nanorq_block_symbols(dec, 0) + 2;
+  for (uint32_t esi = 0; got < need && esi < 65535; esi++) {
+    if (rand() % 10 < 3)
+      continue;
+    nanorq_encode(enc, sym, esi, 0, in);
+    if (nanorq_decoder_add_symbol(dec, sym, nanorq_tag(0, esi), out) ==
+        NANORQ_SYM_ADDED)
+      got++;
+  }
+
+  double t;
+  count_start(&t);
+  bool ok = nanorq_repair_block(dec, out, 0);
+  t = count_stop(t);
+  ok = ok && memcmp(src, dst, len) == 0;
+  printf("%6u %5s %11zu %10.2f ms%s\n", K, full_inactivation ? "rfc" : "fast",
+         allocs, t * 1e3, ok ? "" : "  FAILED");
+
+  nanorq_free(dec);
+  nanorq_free(enc);
+  in->destroy(in);
+  out->destroy(out);
+  free(src);
+  free(dst);
+  return ok;
+}
+
+int main(void) {
+  printf("precode matrix of the encoder, best of %d\n", RUNS);
+  printf("%6s %11s %13s %11s %13s\n", "K", "gen allocs", "gen", "inv allocs",
+         "invert");
+  uint16_t Ks[] = {1000, 10000, 50000};
+  for (int k = 0; k < 3; k++)
+    precode(Ks[k]);
+
+  printf("\nnanorq_repair_block, T=%d, 30%% loss\n", T);
+  printf("%6s %5s %11s %13s\n", "K", "", "allocs", "repair");
+  bool ok = true;
+  for (int k = 0; k < 2; k++) {
+    ok = repair(Ks[k], false) && ok;
+    ok = repair(Ks[k], true) && ok;
+  }
+  return ok ? 0 : 1;
+}
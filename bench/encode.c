@@ -0,0 +1,110 @@
+// repair symbol encoding throughput at the daemon's symbol size of every
+// hermes mode, next to the oblas row kernels it runs on. OBLAS_BACKEND=name
+// picks another kernel backend, see oblas/oblas.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "mercury_modes.h"
+#include "nanorq.h"
+#include "oblas.h"
+
+// daemon frame layout, see daemon.c
+#define FRAME_OVERHEAD (HERMES_SIZE + 8 + 3)
+#define K 1000
+#define ROWS 256
+#define RUNS 3
+#define RUN_SECONDS 0.2
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+typedef struct {
+  nanorq *rq;
+  struct ioctx *io;
+  uint8_t *out;
+  octmat rows;
+  size_t T;
+} bench_ctx;
+
+typedef size_t (*bench_fn)(bench_ctx *c, size_t iter);
+
+static size_t run_oaddrow(bench_ctx *c, size_t iter) {
+  oaddrow(c->rows.data, c->rows.data, iter % ROWS, (iter + 7) % ROWS,
+          c->rows.cols);
+  return 1;
+}
+
+static size_t run_oaxpy(bench_ctx *c, size_t iter) {
+  oaxpy(c->rows.data, c->rows.data, iter % ROWS, (iter + 7) % ROWS,
+        c->rows.cols, 2 + iter % 250);
+  return 1;
+}
+
+static size_t run_encode(bench_ctx *c, size_t iter) {
+  uint32_t esi = K + iter % 60000;
+  return nanorq_encode(c->rq, c->out, esi, 0, c->io) ? 1 : 0;
+}
+
+static size_t run_encode_batch(bench_ctx *c, size_t iter) {
+  uint32_t esi = K + (iter * 32) % 60000;
+  return nanorq_encode_batch(c->rq, 0, esi, 32, c->out, c->T, c->io);
+}
+
+// best of RUNS, in bytes per second
+static double measure(bench_ctx *c, bench_fn fn) {
+  double best = 0;
+  for (int run = 0; run < RUNS; run++) {
+    size_t bytes = 0, iter = 0;
+    double start = now(), t;
+    do {
+      for (int it = 0; it < 64; it++)
+        bytes += fn(c, iter++) * c->T;
+      t = now() - start;
+    } while (t < RUN_SECONDS);
+    if (bytes / t > best)
+      best = bytes / t;
+  }
+  return best;
+}
+
+int main(void) {
+  printf("oblas backend: %s, K=%d\n\n", oblas_backend(), K);
+  printf("%4s %4s %13s %13s %13s %13s\n", "mode", "T", "oaddrow", "oaxpy",
+         "encode", "encode_batch");
+  for (int mode = 0; mode <= HERMES_MODE_MAX; mode++) {
+    if (hermes_frame_size[mode] <= FRAME_OVERHEAD)
+      continue;
+    bench_ctx c = {0};
+    c.T = hermes_frame_size[mode] - FRAME_OVERHEAD;
+    size_t len = c.T * K;
+    uint8_t *src = malloc(len);
+    for (size_t i = 0; i < len; i++)
+      src[i] = rand();
+    c.io = ioctx_from_mem(src, len);
+    c.rq = nanorq_encoder_new_ex(len, c.T, 0, 1, 1);
+    nanorq_set_max_esi(c.rq, 65535 + K);
+    nanorq_generate_all_symbols(c.rq, c.io, 1);
+    c.out = malloc(32 * c.T);
+    c.rows = (octmat)OM_INITIAL;
+    om_resize(&c.rows, ROWS, c.T);
+    for (size_t i = 0; i < ROWS * c.rows.cols_al; i++)
+      c.rows.data[i] = rand();
+
+    printf("%4d %4zu", mode, c.T);
+    bench_fn fns[] = {run_oaddrow, run_oaxpy, run_encode, run_encode_batch};
+    for (int f = 0; f < 4; f++)
+      printf(" %8.1f MB/s", measure(&c, fns[f]) / 1e6);
+    printf("\n");
+
+    om_destroy(&c.rows);
+    free(c.out);
+    nanorq_free(c.rq);
+    c.io->destroy(c.io);
+    free(src);
+  }
+  return 0;
+}
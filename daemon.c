@@ -27,24 +27,40 @@
 #endif
 
 #include "crc6.h"
+#include "frame_ring.h"
 #include "kiss.h"
 #include "mercury_modes.h"
 #include "tcp_interface.h"
 
 #include <nanorq.h>
+#include <oblas.h>
 
 #define CONFIG_BODY_SIZE 8
 #define TAG_BODY_SIZE 3
 #define MAX_ESI 65535
+// symbols encoded per block ahead of the modem feed
+#define TX_BATCH 32
+// ready frames queued between the encoder and the sender thread
+#define TX_RING_DEPTH 64
+// received frames queued between the socket reader and the decoder thread
+#define RX_RING_DEPTH 1024
 
 typedef struct {
     int mode;
     uint32_t frame_size;
     uint32_t symbol_size;
+    unsigned threads;
     bool verbose;
+    bool full_inactivation; // RFC 6330 row selection when a block is inverted
+    uint32_t incremental_max; // largest K' decoded as symbols arrive
+    char cache_path[PATH_MAX];
     char tx_dir[PATH_MAX];
     char rx_dir[PATH_MAX];
     tcp_interface_t tcp_iface;
+    frame_ring_t tx_ring;   // encoder thread -> sender thread
+    frame_ring_t rx_ring;   // socket reader -> decoder thread
+    atomic_bool tx_due;     // a session has frames to send, an empty ring is starvation
+    atomic_uint_fast64_t rx_dropped; // frames the reader found no room for in rx_ring
 } daemon_ctx_t;
 
 typedef struct {
@@ -53,12 +69,16 @@ typedef struct {
     time_t mtime;
     int64_t frames_limit;   // -1 means continuous
     int64_t frames_sent;
-    int next_sbn;
     uint8_t config_body[CONFIG_BODY_SIZE];
+    uint8_t *src;           // retained copy of the input behind myio
     struct ioctx *myio;
     nanorq *rq;
     uint32_t *esi;
     int num_sbn;
+    uint8_t *frames;        // TX_BATCH * num_sbn prebuilt frames, round robin
+    int frames_ready;
+    int frame_pos;
+    bool repair_ready;      // every block inverted, repair ESIs can go out
 } tx_session_t;
 
 typedef struct {
@@ -73,7 +93,9 @@ typedef struct {
     struct ioctx *myio;
     nanorq *rq;
     bool *block_decoded;
+    int decoded_blocks;
     uint32_t *block_symbols_seen;
+    uint32_t *block_symbols_tried; // seen when the last repair attempt was queued
 } rx_session_t;
 
 static volatile sig_atomic_t running = 1;
@@ -88,7 +110,9 @@ static void tx_session_reset(tx_session_t *tx)
 {
     if (tx->rq) nanorq_free(tx->rq);
     if (tx->myio) tx->myio->destroy(tx->myio);
+    free(tx->src);
     free(tx->esi);
+    free(tx->frames);
     memset(tx, 0, sizeof(*tx));
 }
 
@@ -98,6 +122,7 @@ static void rx_session_reset(rx_session_t *rx)
     if (rx->myio) rx->myio->destroy(rx->myio);
     free(rx->block_decoded);
     free(rx->block_symbols_seen);
+    free(rx->block_symbols_tried);
     bool completed_last = rx->completed_last;
     uint64_t last_common = rx->last_completed_oti_common;
     uint32_t last_scheme = rx->last_completed_oti_scheme;
@@ -248,20 +273,33 @@ static bool tx_session_open(daemon_ctx_t *ctx, tx_session_t *tx, const char *fil
 {
     tx_session_reset(tx);
 
-    tx->myio = ioctx_from_file(file_path, 1);
-    if (!tx->myio)
+    struct ioctx *fio = ioctx_from_file(file_path, 1);
+    if (!fio)
     {
         fprintf(stderr, "TX: failed to open input file: %s\n", file_path);
         return false;
     }
 
-    size_t filesize = tx->myio->size(tx->myio);
+    size_t filesize = fio->size(fio);
     if (filesize > 16777215)
     {
         fprintf(stderr, "TX: file too large (>16MB): %s\n", file_path);
+        fio->destroy(fio);
+        return false;
+    }
+
+    // systematic symbols are served straight from this copy on every
+    // carousel pass, and rewriting the file cannot tear the session
+    tx->src = (uint8_t *)malloc(filesize ? filesize : 1);
+    if (!tx->src || fio->read(fio, tx->src, filesize) != filesize)
+    {
+        fprintf(stderr, "TX: failed to read input file: %s\n", file_path);
+        fio->destroy(fio);
         tx_session_reset(tx);
         return false;
     }
+    fio->destroy(fio);
+    tx->myio = ioctx_from_mem(tx->src, filesize);
 
     tx->rq = nanorq_encoder_new(filesize, ctx->symbol_size, 1);
     if (!tx->rq)
@@ -274,14 +312,21 @@ static bool tx_session_open(daemon_ctx_t *ctx, tx_session_t *tx, const char *fil
 
     tx->num_sbn = nanorq_blocks(tx->rq);
     tx->esi = (uint32_t *)calloc((size_t)tx->num_sbn, sizeof(uint32_t));
-    if (!tx->esi)
+    tx->frames = (uint8_t *)malloc((size_t)TX_BATCH * tx->num_sbn * ctx->frame_size);
+    if (!tx->esi || !tx->frames)
     {
         fprintf(stderr, "TX: failed to allocate ESI counters\n");
         tx_session_reset(tx);
         return false;
     }
 
-    for (int b = 0; b < tx->num_sbn; b++) nanorq_generate_symbols(tx->rq, b, tx->myio);
+    // source symbols go on air right away, blocks invert in the background
+    if (!nanorq_generate_async(tx->rq, tx->myio, ctx->threads))
+    {
+        fprintf(stderr, "TX: failed to load RaptorQ source blocks for: %s\n", file_path);
+        tx_session_reset(tx);
+        return false;
+    }
 
     uint8_t config_packet[CONFIG_PACKET_SIZE] = {0};
     nanorq_oti_common_reduced(tx->rq, config_packet + 1);          // 5 bytes
@@ -292,57 +337,202 @@ static bool tx_session_open(daemon_ctx_t *ctx, tx_session_t *tx, const char *fil
     tx->mtime = mtime;
     tx->frames_limit = parse_frames_limit_from_filename(file_path);
     tx->frames_sent = 0;
-    tx->next_sbn = 0;
     tx->active = true;
 
-    fprintf(stdout, "TX: loaded file %s (frames_limit=%lld, symbol_size=%u, blocks=%d)\n",
-            tx->file_path, (long long)tx->frames_limit, ctx->symbol_size, tx->num_sbn);
+    fprintf(stdout, "TX: loaded file %s (frames_limit=%lld, symbol_size=%u, blocks=%d, mem=%zu KiB)\n",
+            tx->file_path, (long long)tx->frames_limit, ctx->symbol_size, tx->num_sbn,
+            nanorq_peak_memory(tx->rq) / 1024);
     return true;
 }
 
-static bool tx_send_one_frame(daemon_ctx_t *ctx, tx_session_t *tx)
+// latch repair_ready once every block is inverted, waiting for the
+// background inversion when asked to; false only when inversion failed
+static bool tx_check_repair_ready(daemon_ctx_t *ctx, tx_session_t *tx, bool wait)
 {
-    uint8_t frame[ctx->frame_size];
-    uint8_t symbol[ctx->symbol_size];
-
-    int sbn = tx->next_sbn++ % tx->num_sbn;
-    uint32_t esi = tx->esi[sbn];
-    if (esi > MAX_ESI)
+    if (tx->repair_ready)
+        return true;
+    if (wait)
     {
-        tx->esi[sbn] = 0;
-        esi = 0;
+        if (!nanorq_generate_wait(tx->rq))
+        {
+            fprintf(stderr, "TX: failed to generate RaptorQ symbols for: %s\n", tx->file_path);
+            return false;
+        }
     }
-
-    uint64_t written = nanorq_encode(tx->rq, symbol, esi, (uint8_t)sbn, tx->myio);
-    if (written != ctx->symbol_size)
+    else
+    {
+        for (int sbn = 0; sbn < tx->num_sbn; sbn++)
+        {
+            if (!nanorq_block_ready(tx->rq, (uint8_t)sbn))
+                return true;
+        }
+    }
+    tx->repair_ready = true;
+    if (ctx->verbose)
     {
-        fprintf(stderr, "TX: nanorq_encode failed (sbn=%d esi=%u)\n", sbn, esi);
+        size_t raw, ops, passes;
+        fprintf(stdout, "TX: repair symbols ready after %lld frames\n", (long long)tx->frames_sent);
+        if (nanorq_schedule_ops(tx->rq, &raw, &ops, &passes))
+            fprintf(stdout, "TX: precode schedule %zu row ops compiled to %zu in %zu row passes\n",
+                    raw, ops, passes);
+    }
+    if (ctx->cache_path[0] && !nanorq_cache_save(ctx->cache_path))
+        fprintf(stderr, "TX: failed to save schedule cache: %s\n", ctx->cache_path);
+    return true;
+}
+
+// encode the next TX_BATCH ESIs of every block, one nanorq call per block
+// (two when the ESI counter wraps), straight into the payload of the frames.
+// Blocks still inverting only contribute their remaining source symbols.
+static bool tx_encode_round(daemon_ctx_t *ctx, tx_session_t *tx)
+{
+    size_t payload = 1 + CONFIG_BODY_SIZE + TAG_BODY_SIZE;
+    size_t stride = (size_t)tx->num_sbn * ctx->frame_size;
+    int count[tx->num_sbn];
+    int rounds = 0;
+
+    if (!tx_check_repair_ready(ctx, tx, false))
         return false;
+
+    memset(tx->frames, 0, TX_BATCH * stride);
+    for (int sbn = 0; sbn < tx->num_sbn; sbn++)
+    {
+        uint8_t *first = tx->frames + (size_t)sbn * ctx->frame_size;
+        int want = TX_BATCH;
+        if (!tx->repair_ready && !nanorq_block_ready(tx->rq, (uint8_t)sbn))
+        {
+            int left = (int)nanorq_block_symbols(tx->rq, (uint8_t)sbn) - (int)tx->esi[sbn];
+            want = (left < 0) ? 0 : (left < want ? left : want);
+        }
+
+        int done = 0;
+        while (done < want)
+        {
+            if (tx->esi[sbn] > MAX_ESI)
+                tx->esi[sbn] = 0;
+            uint32_t esi = tx->esi[sbn];
+            size_t n = want - done;
+            if (n > MAX_ESI + 1 - esi)
+                n = MAX_ESI + 1 - esi;
+
+            size_t written = nanorq_encode_batch(tx->rq, (uint8_t)sbn, esi, n,
+                                                 first + done * stride + payload,
+                                                 stride, tx->myio);
+            if (written != n)
+            {
+                fprintf(stderr, "TX: nanorq_encode failed (sbn=%d esi=%u)\n",
+                        sbn, esi + (unsigned)written);
+                return false;
+            }
+            for (size_t i = 0; i < n; i++)
+            {
+                uint8_t *frame = first + (done + i) * stride;
+                memcpy(frame + 1, tx->config_body, CONFIG_BODY_SIZE);
+                nanorq_tag_reduced((uint8_t)sbn, esi + (uint32_t)i, frame + 1 + CONFIG_BODY_SIZE);
+                frame[0] = (PACKET_RQ_CONFIG << 6) & 0xff;
+                frame[0] |= crc6_0X6F(1, frame + HERMES_SIZE, (int)ctx->frame_size - HERMES_SIZE);
+            }
+            tx->esi[sbn] += (uint32_t)n;
+            done += (int)n;
+        }
+        count[sbn] = done;
+        if (done > rounds)
+            rounds = done;
     }
-    tx->esi[sbn]++;
 
-    memset(frame, 0, sizeof(frame));
-    memcpy(frame + 1, tx->config_body, CONFIG_BODY_SIZE);
-    nanorq_tag_reduced((uint8_t)sbn, esi, frame + 1 + CONFIG_BODY_SIZE);
-    memcpy(frame + 1 + CONFIG_BODY_SIZE + TAG_BODY_SIZE, symbol, ctx->symbol_size);
+    // nothing but repair symbols of blocks still inverting is left to send
+    if (rounds == 0)
+    {
+        if (!tx_check_repair_ready(ctx, tx, true))
+            return false;
+        return tx_encode_round(ctx, tx);
+    }
 
-    frame[0] = (PACKET_RQ_CONFIG << 6) & 0xff;
-    frame[0] |= crc6_0X6F(1, frame + HERMES_SIZE, (int)ctx->frame_size - HERMES_SIZE);
+    // close the gaps left by blocks that ran out of source symbols
+    int ready = 0;
+    for (int r = 0; r < rounds; r++)
+    {
+        for (int sbn = 0; sbn < tx->num_sbn; sbn++)
+        {
+            if (r >= count[sbn])
+                continue;
+            int at = r * tx->num_sbn + sbn;
+            if (at != ready)
+                memcpy(tx->frames + (size_t)ready * ctx->frame_size,
+                       tx->frames + (size_t)at * ctx->frame_size, ctx->frame_size);
+            ready++;
+        }
+    }
+    tx->frames_ready = ready;
+    tx->frame_pos = 0;
+    return true;
+}
 
-    if (tcp_interface_send_kiss(&ctx->tcp_iface, frame, ctx->frame_size) < 0)
+static bool tx_queue_one_frame(daemon_ctx_t *ctx, tx_session_t *tx)
+{
+    uint8_t *slot = frame_ring_slot(&ctx->tx_ring);
+    if (!slot)
     {
-        fprintf(stderr, "TX: failed to send frame to modem\n");
-        return false;
+        // the sender is behind the modem, come back after the file checks
+        usleep(1000);
+        return true;
     }
 
+    if (tx->frame_pos == tx->frames_ready && !tx_encode_round(ctx, tx))
+        return false;
+    memcpy(slot, tx->frames + (size_t)tx->frame_pos++ * ctx->frame_size, ctx->frame_size);
+    frame_ring_push(&ctx->tx_ring);
+
     tx->frames_sent++;
     if (ctx->verbose && (tx->frames_sent % 100) == 0)
     {
-        fprintf(stdout, "TX: sent=%lld file=%s\n", (long long)tx->frames_sent, tx->file_path);
+        fprintf(stdout, "TX: queued=%lld sent=%llu ring=%zu/%d starved=%llu ring_full=%llu file=%s\n",
+                (long long)tx->frames_sent,
+                (unsigned long long)atomic_load(&ctx->tx_ring.popped),
+                frame_ring_count(&ctx->tx_ring), TX_RING_DEPTH,
+                (unsigned long long)atomic_load(&ctx->tx_ring.starved),
+                (unsigned long long)atomic_load(&ctx->tx_ring.full_waits),
+                tx->file_path);
     }
     return true;
 }
 
+// drains the ready ring to the modem, nothing else may block this thread
+static void *tx_sender_main(void *arg)
+{
+    daemon_ctx_t *ctx = (daemon_ctx_t *)arg;
+    bool starving = false;
+
+    while (running)
+    {
+        uint8_t *frame = frame_ring_peek(&ctx->tx_ring);
+        if (!frame)
+        {
+            if (!atomic_load(&ctx->tx_due))
+            {
+                starving = false;
+                usleep(20000);
+                continue;
+            }
+            if (!starving)
+                atomic_fetch_add(&ctx->tx_ring.starved, 1);
+            starving = true;
+            usleep(1000);
+            continue;
+        }
+        starving = false;
+
+        if (tcp_interface_send_kiss(&ctx->tcp_iface, frame, ctx->frame_size) < 0)
+        {
+            fprintf(stderr, "TX: failed to send frame to modem\n");
+            running = 0;
+            break;
+        }
+        frame_ring_pop(&ctx->tx_ring);
+    }
+    return NULL;
+}
+
 static uint64_t parse_oti_common_from_frame(const uint8_t *frame)
 {
     uint64_t oti_common = 0;
@@ -389,11 +579,14 @@ static bool rx_session_start(daemon_ctx_t *ctx, rx_session_t *rx, uint64_t oti_c
         return false;
     }
     nanorq_set_max_esi(rx->rq, MAX_ESI);
+    nanorq_set_full_inactivation(rx->rq, ctx->full_inactivation);
+    nanorq_set_incremental_max(rx->rq, ctx->incremental_max);
 
     rx->num_sbn = nanorq_blocks(rx->rq);
     rx->block_decoded = (bool *)calloc((size_t)rx->num_sbn, sizeof(bool));
     rx->block_symbols_seen = (uint32_t *)calloc((size_t)rx->num_sbn, sizeof(uint32_t));
-    if (!rx->block_decoded || !rx->block_symbols_seen)
+    rx->block_symbols_tried = (uint32_t *)calloc((size_t)rx->num_sbn, sizeof(uint32_t));
+    if (!rx->block_decoded || !rx->block_symbols_seen || !rx->block_symbols_tried)
     {
         fprintf(stderr, "RX: allocation failed for decoder state\n");
         rx_session_reset(rx);
@@ -410,11 +603,8 @@ static bool rx_session_start(daemon_ctx_t *ctx, rx_session_t *rx, uint64_t oti_c
 
 static bool rx_session_is_complete(rx_session_t *rx)
 {
-    for (int i = 0; i < rx->num_sbn; i++)
-    {
-        if (!rx->block_decoded[i]) return false;
-    }
-    return true;
+    // the decoder counts the blocks still missing symbols as they arrive
+    return nanorq_decoder_progress(rx->rq, 0, NULL, NULL, NULL) == 0;
 }
 
 static void *tx_thread_main(void *arg)
@@ -439,12 +629,15 @@ static void *tx_thread_main(void *arg)
             if (stat(tx.file_path, &st) != 0)
             {
                 fprintf(stdout, "TX: file removed, stopping %s\n", tx.file_path);
+                atomic_store(&ctx->tx_due, false);
+                frame_ring_flush(&ctx->tx_ring);
                 tx_session_reset(&tx);
                 continue;
             }
             if (st.st_mtime != tx.mtime)
             {
                 fprintf(stdout, "TX: file changed, reloading %s\n", tx.file_path);
+                frame_ring_flush(&ctx->tx_ring);
                 tx_session_open(ctx, &tx, tx.file_path, st.st_mtime);
                 continue;
             }
@@ -481,16 +674,19 @@ static void *tx_thread_main(void *arg)
 
         if (tx.frames_limit != -1 && tx.frames_sent >= tx.frames_limit)
         {
+            atomic_store(&ctx->tx_due, false);
             usleep(200000);
             continue;
         }
 
-        if (!tx_send_one_frame(ctx, &tx))
+        atomic_store(&ctx->tx_due, true);
+        if (!tx_queue_one_frame(ctx, &tx))
         {
             running = 0;
             break;
         }
     }
+    atomic_store(&ctx->tx_due, false);
 
 #if defined(__linux__)
     tx_watch_close(&watch_fd, &watch_wd);
@@ -499,12 +695,129 @@ static void *tx_thread_main(void *arg)
     return NULL;
 }
 
-static void *rx_thread_main(void *arg)
+// queue a repair attempt for sbn once it holds enough symbols, and again
+// after a failed attempt only when symbols arrived since
+static void rx_try_repair(daemon_ctx_t *ctx, rx_session_t *rx, uint8_t sbn)
+{
+    uint32_t seen = rx->block_symbols_seen[sbn];
+    if (rx->block_decoded[sbn] ||
+        seen < nanorq_block_symbols(rx->rq, sbn) ||
+        seen == rx->block_symbols_tried[sbn])
+        return;
+    if (nanorq_repair_async(rx->rq, sbn, ctx->threads))
+        rx->block_symbols_tried[sbn] = seen;
+}
+
+// counts sbn once the decoder holds all of its source symbols, whether they
+// arrived, were decoded on arrival or came out of a repair attempt
+static void rx_note_block(daemon_ctx_t *ctx, rx_session_t *rx, uint8_t sbn)
+{
+    if (rx->block_decoded[sbn] || nanorq_num_missing(rx->rq, sbn) > 0)
+        return;
+    rx->block_decoded[sbn] = true;
+    rx->decoded_blocks++;
+    if (ctx->verbose) fprintf(stdout, "RX: block %d decoded\n", sbn);
+}
+
+// completion events of the repair attempts, their symbols go out to the file
+static void rx_reap_repairs(daemon_ctx_t *ctx, rx_session_t *rx)
+{
+    bool repaired;
+    int sbn;
+    while ((sbn = nanorq_repair_reap(rx->rq, rx->myio, false, &repaired)) >= 0)
+    {
+        if (repaired)
+        {
+            rx_note_block(ctx, rx, (uint8_t)sbn);
+            continue;
+        }
+        if (ctx->verbose) fprintf(stdout, "RX: block %d repair attempt failed\n", sbn);
+        rx_try_repair(ctx, rx, (uint8_t)sbn);
+    }
+}
+
+static void rx_check_complete(rx_session_t *rx)
+{
+    if (!rx->active || !rx_session_is_complete(rx))
+        return;
+    fprintf(stdout, "RX: FILE RECEIVED -> %s (peak_mem=%zu KiB)\n",
+            rx->out_path, nanorq_peak_memory(rx->rq) / 1024);
+    rx->completed_last = true;
+    rx->last_completed_oti_common = rx->oti_common;
+    rx->last_completed_oti_scheme = rx->oti_scheme;
+    rx_session_reset(rx);
+}
+
+// returns false when the frame fails its crc
+static bool rx_handle_frame(daemon_ctx_t *ctx, rx_session_t *rx, uint8_t *frame)
+{
+    uint8_t packet_type = (frame[0] >> 6) & 0x3;
+    if (packet_type == PACKET_RQ_PAYLOAD)
+    {
+        if (ctx->verbose) fprintf(stdout, "RX: side-info packet (0x03) len=%u\n", ctx->frame_size);
+        return true;
+    }
+    if (packet_type != PACKET_RQ_CONFIG) return true; // v2 data path is 0x02
+
+    uint8_t crc_local = frame[0] & 0x3f;
+    uint8_t crc_calc = (uint8_t)crc6_0X6F(1, frame + HERMES_SIZE, (int)ctx->frame_size - HERMES_SIZE);
+    if (crc_local != crc_calc)
+        return false;
+
+    uint64_t oti_common = parse_oti_common_from_frame(frame);
+    uint32_t oti_scheme = parse_oti_scheme_from_frame(frame);
+
+    if (rx->completed_last &&
+        rx->last_completed_oti_common == oti_common &&
+        rx->last_completed_oti_scheme == oti_scheme &&
+        !rx->active)
+    {
+        return true;
+    }
+
+    if (!rx->active ||
+        rx->oti_common != oti_common ||
+        rx->oti_scheme != oti_scheme)
+    {
+        if (!rx_session_start(ctx, rx, oti_common, oti_scheme))
+        {
+            return true;
+        }
+        rx->completed_last = false;
+    }
+
+    uint8_t sbn = frame[1 + CONFIG_BODY_SIZE];
+    uint32_t esi = (uint32_t)frame[1 + CONFIG_BODY_SIZE + 1] |
+                   ((uint32_t)frame[1 + CONFIG_BODY_SIZE + 2] << 8);
+    uint32_t tag = nanorq_tag(sbn, esi);
+
+    int ret = nanorq_decoder_add_symbol(rx->rq,
+                                        frame + 1 + CONFIG_BODY_SIZE + TAG_BODY_SIZE,
+                                        tag,
+                                        rx->myio);
+    if (ret == NANORQ_SYM_ADDED)
+    {
+        rx->block_symbols_seen[sbn]++;
+        rx_note_block(ctx, rx, sbn);
+        rx_try_repair(ctx, rx, sbn);
+    }
+    else if (ret == NANORQ_SYM_ERR)
+    {
+        if (ctx->verbose)
+        {
+            fprintf(stderr,
+                    "RX: nanorq_decoder_add_symbol error for sbn=%u, esi=%u\n",
+                    (unsigned int)sbn,
+                    (unsigned int)esi);
+        }
+    }
+    return true;
+}
+
+// drains the modem socket into the rx ring, decoding never blocks this thread
+static void *rx_reader_main(void *arg)
 {
     daemon_ctx_t *ctx = (daemon_ctx_t *)arg;
-    rx_session_t rx = {0};
-    uint64_t frames_rx = 0;
-    uint64_t crc_errors = 0;
 
     uint8_t frame[MAX_PAYLOAD];
     while (running)
@@ -518,7 +831,6 @@ static void *rx_thread_main(void *arg)
             break;
         }
 
-        frames_rx++;
         if ((uint32_t)frame_len != ctx->frame_size)
         {
             if (ctx->verbose)
@@ -526,91 +838,58 @@ static void *rx_thread_main(void *arg)
             continue;
         }
 
-        uint8_t packet_type = (frame[0] >> 6) & 0x3;
-        if (packet_type == PACKET_RQ_PAYLOAD)
+        // with the decoder this far behind the frame is dropped, the
+        // carousel sends others and rx_dropped counts them
+        uint8_t *slot = frame_ring_slot(&ctx->rx_ring);
+        if (!slot)
         {
-            if (ctx->verbose) fprintf(stdout, "RX: side-info packet (0x03) len=%d\n", frame_len);
-            continue;
-        }
-        if (packet_type != PACKET_RQ_CONFIG) continue; // v2 data path is 0x02
-
-        uint8_t crc_local = frame[0] & 0x3f;
-        uint8_t crc_calc = (uint8_t)crc6_0X6F(1, frame + HERMES_SIZE, (int)ctx->frame_size - HERMES_SIZE);
-        if (crc_local != crc_calc)
-        {
-            crc_errors++;
+            atomic_fetch_add(&ctx->rx_dropped, 1);
             continue;
         }
+        memcpy(slot, frame, ctx->frame_size);
+        frame_ring_push(&ctx->rx_ring);
+    }
+    return NULL;
+}
 
-        uint64_t oti_common = parse_oti_common_from_frame(frame);
-        uint32_t oti_scheme = parse_oti_scheme_from_frame(frame);
-
-        if (rx.completed_last &&
-            rx.last_completed_oti_common == oti_common &&
-            rx.last_completed_oti_scheme == oti_scheme &&
-            !rx.active)
-        {
-            continue;
-        }
+// session logic and decoding, repair attempts run on the decoder's pool
+static void *rx_thread_main(void *arg)
+{
+    daemon_ctx_t *ctx = (daemon_ctx_t *)arg;
+    rx_session_t rx = {0};
+    uint64_t frames_rx = 0;
+    uint64_t crc_errors = 0;
 
-        if (!rx.active ||
-            rx.oti_common != oti_common ||
-            rx.oti_scheme != oti_scheme)
+    while (running)
+    {
+        if (rx.active)
         {
-            if (!rx_session_start(ctx, &rx, oti_common, oti_scheme))
-            {
-                continue;
-            }
-            rx.completed_last = false;
+            rx_reap_repairs(ctx, &rx);
+            rx_check_complete(&rx);
         }
 
-        uint8_t sbn = frame[1 + CONFIG_BODY_SIZE];
-        uint32_t esi = (uint32_t)frame[1 + CONFIG_BODY_SIZE + 1] |
-                       ((uint32_t)frame[1 + CONFIG_BODY_SIZE + 2] << 8);
-        uint32_t tag = nanorq_tag(sbn, esi);
-
-        int ret = nanorq_decoder_add_symbol(rx.rq,
-                                            frame + 1 + CONFIG_BODY_SIZE + TAG_BODY_SIZE,
-                                            tag,
-                                            rx.myio);
-        if (ret == NANORQ_SYM_ADDED)
-        {
-            rx.block_symbols_seen[sbn]++;
-            if (!rx.block_decoded[sbn] &&
-                rx.block_symbols_seen[sbn] >= nanorq_block_symbols(rx.rq, sbn))
-            {
-                if (nanorq_repair_block(rx.rq, rx.myio, sbn))
-                {
-                    rx.block_decoded[sbn] = true;
-                    if (ctx->verbose) fprintf(stdout, "RX: block %u decoded\n", sbn);
-                }
-            }
-        }
-        else if (ret == NANORQ_SYM_ERR)
+        uint8_t *frame = frame_ring_peek(&ctx->rx_ring);
+        if (!frame)
         {
-            if (ctx->verbose)
-            {
-                fprintf(stderr,
-                        "RX: nanorq_decoder_add_symbol error for sbn=%u, esi=%u\n",
-                        (unsigned int)sbn,
-                        (unsigned int)esi);
-            }
+            usleep(1000);
+            continue;
         }
 
-        if (rx_session_is_complete(&rx))
-        {
-            fprintf(stdout, "RX: FILE RECEIVED -> %s\n", rx.out_path);
-            rx.completed_last = true;
-            rx.last_completed_oti_common = rx.oti_common;
-            rx.last_completed_oti_scheme = rx.oti_scheme;
-            rx_session_reset(&rx);
-        }
+        frames_rx++;
+        if (!rx_handle_frame(ctx, &rx, frame))
+            crc_errors++;
+        frame_ring_pop(&ctx->rx_ring);
+        rx_check_complete(&rx);
 
         if (ctx->verbose && (frames_rx % 200) == 0)
         {
-            fprintf(stdout, "RX: frames=%llu crc_errors=%llu\n",
+            fprintf(stdout, "RX: frames=%llu crc_errors=%llu blocks=%d/%d ring=%zu/%d ring_full=%llu dropped=%llu\n",
                     (unsigned long long)frames_rx,
-                    (unsigned long long)crc_errors);
+                    (unsigned long long)crc_errors,
+                    rx.decoded_blocks, rx.num_sbn,
+                    frame_ring_count(&ctx->rx_ring), RX_RING_DEPTH,
+                    (unsigned long long)atomic_load(&ctx->rx_ring.full_waits),
+                    (unsigned long long)atomic_load(&ctx->rx_dropped));
         }
     }
 
@@ -626,6 +905,12 @@ static void print_usage(const char *prog)
     printf("  -r, --rx-dir DIR     RX output directory (default: ./rx)\n");
     printf("  -i, --ip IP          modem IP (default: 127.0.0.1)\n");
     printf("  -p, --port PORT      modem TCP port (default: 8100)\n");
+    printf("  -T, --threads N      encoder and decoder threads (default: number of CPUs)\n");
+    printf("  -c, --cache FILE     persist precode schedules in FILE across restarts\n");
+    printf("  -F, --full-inactivation  RFC 6330 row selection when inverting blocks,\n");
+    printf("                       only blocks with K' above --incremental-max are inverted\n");
+    printf("  -I, --incremental-max K  largest K' decoded as symbols arrive, 0 inverts\n");
+    printf("                       every block once enough arrived (default: %d)\n", NANORQ_INC_MAX_KPRIME);
     printf("  -v, --verbose        verbose logs\n");
     printf("  -h, --help           show help\n");
     printf("\n");
@@ -638,11 +923,13 @@ int main(int argc, char *argv[])
     daemon_ctx_t ctx;
     memset(&ctx, 0, sizeof(ctx));
     ctx.mode = 1;
+    ctx.incremental_max = NANORQ_INC_MAX_KPRIME;
     strncpy(ctx.tx_dir, "./tx", sizeof(ctx.tx_dir) - 1);
     strncpy(ctx.rx_dir, "./rx", sizeof(ctx.rx_dir) - 1);
     char ip[64];
     strncpy(ip, DEFAULT_MODEM_IP, sizeof(ip) - 1);
     int port = DEFAULT_MODEM_PORT;
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
 
     static struct option long_opts[] = {
         {"mode", required_argument, 0, 'm'},
@@ -650,13 +937,17 @@ int main(int argc, char *argv[])
         {"rx-dir", required_argument, 0, 'r'},
         {"ip", required_argument, 0, 'i'},
         {"port", required_argument, 0, 'p'},
+        {"threads", required_argument, 0, 'T'},
+        {"cache", required_argument, 0, 'c'},
+        {"full-inactivation", no_argument, 0, 'F'},
+        {"incremental-max", required_argument, 0, 'I'},
         {"verbose", no_argument, 0, 'v'},
         {"help", no_argument, 0, 'h'},
         {0, 0, 0, 0}
     };
 
     int opt;
-    while ((opt = getopt_long(argc, argv, "m:t:r:i:p:vh", long_opts, NULL)) != -1)
+    while ((opt = getopt_long(argc, argv, "m:t:r:i:p:T:c:FI:vh", long_opts, NULL)) != -1)
     {
         switch (opt)
         {
@@ -665,6 +956,10 @@ int main(int argc, char *argv[])
         case 'r': strncpy(ctx.rx_dir, optarg, sizeof(ctx.rx_dir) - 1); break;
         case 'i': strncpy(ip, optarg, sizeof(ip) - 1); break;
         case 'p': port = atoi(optarg); break;
+        case 'T': threads = atoi(optarg); break;
+        case 'c': strncpy(ctx.cache_path, optarg, sizeof(ctx.cache_path) - 1); break;
+        case 'F': ctx.full_inactivation = true; break;
+        case 'I': ctx.incremental_max = (uint32_t)strtoul(optarg, NULL, 10); break;
         case 'v': ctx.verbose = true; break;
         case 'h':
             print_usage(argv[0]);
@@ -688,6 +983,9 @@ int main(int argc, char *argv[])
         return 1;
     }
     ctx.symbol_size = ctx.frame_size - HERMES_SIZE - CONFIG_BODY_SIZE - TAG_BODY_SIZE;
+    ctx.threads = (threads > 0) ? (unsigned)threads : 1;
+    if (ctx.cache_path[0] && nanorq_cache_load(ctx.cache_path) && ctx.verbose)
+        fprintf(stdout, "Loaded schedule cache: %s\n", ctx.cache_path);
 
     mkdir(ctx.rx_dir, 0775);
     mkdir(ctx.tx_dir, 0775);
@@ -702,19 +1000,41 @@ int main(int argc, char *argv[])
         return 1;
     }
 
-    fprintf(stdout, "broadcast_daemon: mode=%d frame_size=%u symbol_size=%u tx_dir=%s rx_dir=%s\n",
-            ctx.mode, ctx.frame_size, ctx.symbol_size, ctx.tx_dir, ctx.rx_dir);
+    fprintf(stdout, "broadcast_daemon: mode=%d frame_size=%u symbol_size=%u tx_dir=%s rx_dir=%s oblas=%s\n",
+            ctx.mode, ctx.frame_size, ctx.symbol_size, ctx.tx_dir, ctx.rx_dir, oblas_backend());
+
+    if (!frame_ring_init(&ctx.tx_ring, TX_RING_DEPTH, ctx.frame_size))
+    {
+        fprintf(stderr, "Failed to allocate TX frame ring\n");
+        tcp_interface_disconnect(&ctx.tcp_iface);
+        return 1;
+    }
+    if (!frame_ring_init(&ctx.rx_ring, RX_RING_DEPTH, ctx.frame_size))
+    {
+        fprintf(stderr, "Failed to allocate RX frame ring\n");
+        frame_ring_free(&ctx.tx_ring);
+        tcp_interface_disconnect(&ctx.tcp_iface);
+        return 1;
+    }
+    atomic_init(&ctx.tx_due, false);
+    atomic_init(&ctx.rx_dropped, 0);
 
-    pthread_t tx_tid, rx_tid;
+    pthread_t tx_tid, sender_tid, rx_tid, reader_tid;
     pthread_create(&tx_tid, NULL, tx_thread_main, &ctx);
+    pthread_create(&sender_tid, NULL, tx_sender_main, &ctx);
     pthread_create(&rx_tid, NULL, rx_thread_main, &ctx);
+    pthread_create(&reader_tid, NULL, rx_reader_main, &ctx);
 
     while (running) sleep(1);
 
     if (ctx.tcp_iface.socket >= 0) shutdown(ctx.tcp_iface.socket, SHUT_RDWR);
 
     pthread_join(tx_tid, NULL);
+    pthread_join(sender_tid, NULL);
     pthread_join(rx_tid, NULL);
+    pthread_join(reader_tid, NULL);
     tcp_interface_disconnect(&ctx.tcp_iface);
+    frame_ring_free(&ctx.tx_ring);
+    frame_ring_free(&ctx.rx_ring);
     return 0;
 }
@@ -0,0 +1,100 @@
+/* Lock-free single producer / single consumer ring of fixed size frames
+ *
+ * Copyright (C) 2020-2024 Rhizomatica
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ */
+
+#include "frame_ring.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+bool frame_ring_init(frame_ring_t *ring, size_t depth, size_t slot_size)
+{
+    memset(ring, 0, sizeof(*ring));
+    ring->slots = (uint8_t *)malloc(depth * slot_size);
+    if (!ring->slots)
+        return false;
+    ring->depth = depth;
+    ring->slot_size = slot_size;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->discard, 0);
+    atomic_init(&ring->popped, 0);
+    atomic_init(&ring->starved, 0);
+    atomic_init(&ring->full_waits, 0);
+    return true;
+}
+
+void frame_ring_free(frame_ring_t *ring)
+{
+    free(ring->slots);
+    ring->slots = NULL;
+}
+
+uint8_t *frame_ring_slot(frame_ring_t *ring)
+{
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+    // a producer polling a full ring counts it once, not on every poll
+    if (head - tail >= ring->depth)
+    {
+        if (!ring->full)
+            atomic_fetch_add_explicit(&ring->full_waits, 1, memory_order_relaxed);
+        ring->full = true;
+        return NULL;
+    }
+    ring->full = false;
+    return ring->slots + (head % ring->depth) * ring->slot_size;
+}
+
+void frame_ring_push(frame_ring_t *ring)
+{
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+void frame_ring_flush(frame_ring_t *ring)
+{
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    atomic_store_explicit(&ring->discard, head, memory_order_release);
+}
+
+uint8_t *frame_ring_peek(frame_ring_t *ring)
+{
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t discard = atomic_load_explicit(&ring->discard, memory_order_acquire);
+
+    // only the consumer moves tail, so flushed frames are skipped here
+    if ((ptrdiff_t)(discard - tail) > 0)
+    {
+        tail = discard;
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+    }
+
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    if (head == tail)
+        return NULL;
+    return ring->slots + (tail % ring->depth) * ring->slot_size;
+}
+
+void frame_ring_pop(frame_ring_t *ring)
+{
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    atomic_fetch_add_explicit(&ring->popped, 1, memory_order_relaxed);
+}
+
+size_t frame_ring_count(frame_ring_t *ring)
+{
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    size_t discard = atomic_load_explicit(&ring->discard, memory_order_acquire);
+
+    if ((ptrdiff_t)(discard - tail) > 0)
+        tail = discard;
+    return head - tail;
+}
@@ -0,0 +1,51 @@
+/* Lock-free single producer / single consumer ring of fixed size frames
+ *
+ * Copyright (C) 2020-2024 Rhizomatica
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct {
+    uint8_t *slots;
+    size_t slot_size;
+    size_t depth;
+
+    // free running counters, slot index is counter % depth
+    atomic_size_t head;     // written by the producer only
+    atomic_size_t tail;     // written by the consumer only
+    atomic_size_t discard;  // frames before this are dropped by the consumer
+    bool full;              // the producer's last frame_ring_slot() found no room
+
+    // stats
+    atomic_uint_fast64_t popped;
+    atomic_uint_fast64_t starved;    // consumer found the ring empty while frames were due
+    atomic_uint_fast64_t full_waits; // producer ran into a full ring, once per episode
+} frame_ring_t;
+
+// returns false if the slots cannot be allocated
+bool frame_ring_init(frame_ring_t *ring, size_t depth, size_t slot_size);
+void frame_ring_free(frame_ring_t *ring);
+
+// producer: returns the next free slot or NULL when the ring is full,
+// frame_ring_push() hands the slot over to the consumer
+uint8_t *frame_ring_slot(frame_ring_t *ring);
+void frame_ring_push(frame_ring_t *ring);
+
+// producer: drop every frame queued so far that was not consumed yet
+void frame_ring_flush(frame_ring_t *ring);
+
+// consumer: returns the oldest frame or NULL when the ring is empty,
+// frame_ring_pop() gives the slot back to the producer
+uint8_t *frame_ring_peek(frame_ring_t *ring);
+void frame_ring_pop(frame_ring_t *ring);
+
+// number of frames waiting to be consumed
+size_t frame_ring_count(frame_ring_t *ring);
@@ -45,7 +45,7 @@ gf2mat *gf2mat_copy(gf2mat *_gf2) {
   gf2->stride = _gf2->stride;
   gf2->bits =
       oblas_alloc(_gf2->rows, _gf2->stride * sizeof(gf2word), sizeof(void *));
-  memcpy(gf2->bits, _gf2->bits, sizeof(gf2word) * gf2->stride * gf2->cols);
+  memcpy(gf2->bits, _gf2->bits, sizeof(gf2word) * gf2->stride * gf2->rows);
   return gf2;
 }
 
@@ -54,7 +54,7 @@ int gf2mat_get(gf2mat *gf2, int i, int j) {
     return 0;
   gf2word *a = gf2->bits + i * gf2->stride;
   div_t p = div(j, gf2wsz);
-  gf2word mask = 1 << p.rem;
+  gf2word mask = gf2bit(p.rem);
   return !!(a[p.quot] & mask);
 }
 
@@ -63,7 +63,7 @@ void gf2mat_set(gf2mat *gf2, int i, int j, uint8_t b) {
     return;
   gf2word *a = gf2->bits + i * gf2->stride;
   div_t p = div(j, gf2wsz);
-  gf2word mask = 1 << p.rem;
+  gf2word mask = gf2bit(p.rem);
   a[p.quot] = (b) ? (a[p.quot] | mask) : (a[p.quot] & ~mask);
 }
 
@@ -91,17 +91,17 @@ int gf2mat_nnz(gf2mat *gf2, int i, int s, int e) {
   gf2word *a = gf2->bits + i * gf2->stride;
   div_t sd = div(s, gf2wsz), ed = div(e, gf2wsz);
   unsigned nnz = 0, p = sd.quot;
-  gf2word masks[2] = {~((1 << sd.rem) - 1), ((1 << ed.rem) - 1)};
+  gf2word masks[2] = {~(gf2bit(sd.rem) - 1), (gf2bit(ed.rem) - 1)};
 
   if (sd.rem) {
-    nnz += __builtin_popcount(a[p] & masks[0]);
+    nnz += __builtin_popcountll(a[p] & masks[0]);
     p++;
   }
   for (; p < ed.quot; p++) {
-    nnz += __builtin_popcount(a[p]);
+    nnz += __builtin_popcountll(a[p]);
   }
   if (e > ed.quot) {
-    nnz += __builtin_popcount(a[p] & masks[1]);
+    nnz += __builtin_popcountll(a[p] & masks[1]);
   }
   return nnz;
 }
@@ -112,13 +112,30 @@ void gf2mat_fill(gf2mat *gf2, int i, uint8_t *dst) {
   for (int idx = 0; idx < stride; idx++) {
     gf2word tmp = a[idx];
     while (tmp > 0) {
-      unsigned tz = __builtin_ctz(tmp);
+      unsigned tz = __builtin_ctzll(tmp);
       tmp = tmp & (tmp - 1);
       dst[tz + idx * gf2wsz] = 1;
     }
   }
 }
 
+// bit j of a nibble moved to byte j
+static const uint32_t GF2_SPREAD4[16] = {
+    0x00000000, 0x00000001, 0x00000100, 0x00000101, 0x00010000, 0x00010001,
+    0x00010100, 0x00010101, 0x01000000, 0x01000001, 0x01000100, 0x01000101,
+    0x01010000, 0x01010001, 0x01010100, 0x01010101};
+
+void gf2mat_pack8(gf2mat *gf2, const int *rows, int n, uint8_t *dst) {
+  for (size_t c = 0; c < (gf2->cols + 7) / 8; c++) {
+    uint64_t acc = 0;
+    for (int s = 0; s < n; s++) {
+      uint8_t x = ((uint8_t *)(gf2->bits + rows[s] * gf2->stride))[c];
+      acc |= ((uint64_t)GF2_SPREAD4[x >> 4] << 32 | GF2_SPREAD4[x & 0x0f]) << s;
+    }
+    memcpy(dst + 8 * c, &acc, sizeof(acc));
+  }
+}
+
 void gf2mat_swaprow(gf2mat *gf2, int i, int j) {
   if (i == j)
     return;
@@ -145,11 +162,11 @@ void gf2mat_swapcol(gf2mat *gf2, int i, int j) {
   unsigned stride = gf2->stride;
   unsigned m = gf2->rows;
   for (int r = 0; r < m; r++, p += stride, q += stride) {
-    unsigned ibit = a[p] & (1 << (i % gf2wsz));
-    unsigned jbit = a[q] & (1 << (j % gf2wsz));
-    mask = 1 << (j % gf2wsz);
+    gf2word ibit = a[p] & gf2bit(i);
+    gf2word jbit = a[q] & gf2bit(j);
+    mask = gf2bit(j);
     a[p] = (ibit) ? (a[p] | mask) : (a[p] & ~mask);
-    mask = 1 << (i % gf2wsz);
+    mask = gf2bit(i);
     a[q] = (jbit) ? (a[q] | mask) : (a[q] & ~mask);
   }
 }
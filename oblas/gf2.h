@@ -4,11 +4,14 @@
 #include <stdint.h>
 #include <stdio.h>
 
-#define gf2word uint32_t
+// rows are 64 bit words, little endian so oaxpy_b32 can read them as
+// 32 bit halves
+#define gf2word uint64_t
 #define gf2wsz (sizeof(gf2word) * 8)
+#define gf2bit(j) ((gf2word)1 << ((j) % gf2wsz))
 
 #define gf2_at(g, i, j)                                                        \
-  (!!((g->bits + (i)*g->stride)[(j) / gf2wsz] & (1U << ((j) % gf2wsz))))
+  (!!((g->bits + (i)*g->stride)[(j) / gf2wsz] & gf2bit(j)))
 
 typedef struct {
   size_t rows;
@@ -30,6 +33,9 @@ void gf2mat_and(gf2mat *a, gf2mat *b, int i, int j);
 
 int gf2mat_nnz(gf2mat *gf2, int i, int s, int e);
 void gf2mat_fill(gf2mat *gf2, int i, uint8_t *dst);
+// byte j of dst gets bit j of rows[s] at bit s, for n <= 8 rows, writes cols
+// rounded up to 8 bytes
+void gf2mat_pack8(gf2mat *gf2, const int *rows, int n, uint8_t *dst);
 
 void gf2mat_swaprow(gf2mat *gf2, int i, int j);
 void gf2mat_swapcol(gf2mat *gf2, int i, int j);
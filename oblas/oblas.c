@@ -1,21 +1,165 @@
 #include "oblas.h"
+#include "oblas_kernels.h"
 #include "util.h"
 #include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__linux__) && (defined(__aarch64__) || defined(__arm__))
+#include <sys/auxv.h>
+#endif
 
-#ifdef OBLAS_SSE
-#include "oblas_sse.c"
-#else
-#ifdef OBLAS_AVX
-#include "oblas_avx.c"
-#else
-#ifdef OBLAS_AVX512
-#include "oblas_avx512.c"
-#else
-#ifdef OBLAS_NEON
-#include "oblas_neon.c"
+// rows and columns of b in one ogemm slab, columns stay a multiple of every
+// backend's vector width
+#define OBLAS_GEMM_KB 64
+#define OBLAS_GEMM_MB 4096
+
+// candidate backends, best first
+static const oblas_kernels *oblas_backends[] = {
+#if defined(__x86_64__) || defined(__i386__)
+    &oblas_gfni,
+    &oblas_avx512,
+    &oblas_avx,
+    &oblas_sse,
+#endif
+#if defined(__aarch64__) || defined(__ARM_NEON)
+    &oblas_neon,
+#endif
+    &oblas_classic,
+};
+
+#define OBLAS_BACKENDS (sizeof(oblas_backends) / sizeof(oblas_backends[0]))
+
+static const oblas_kernels *ok = &oblas_classic;
+
+static bool oblas_cpu_supports(oblas_cpu cpu) {
+  switch (cpu) {
+  case OBLAS_CPU_ANY:
+    return true;
+#if defined(__x86_64__) || defined(__i386__)
+  case OBLAS_CPU_SSSE3:
+    return __builtin_cpu_supports("ssse3");
+  case OBLAS_CPU_AVX2:
+    return __builtin_cpu_supports("avx2");
+  case OBLAS_CPU_AVX512BW:
+    return __builtin_cpu_supports("avx512bw");
+  case OBLAS_CPU_GFNI:
+    return __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("gfni");
+#endif
+#if defined(__aarch64__)
+  case OBLAS_CPU_NEON:
+#if defined(__linux__)
+    return (getauxval(AT_HWCAP) & HWCAP_ASIMD) != 0;
 #else
-#include "oblas_classic.c"
+    return true;
 #endif
+#elif defined(__ARM_NEON)
+  case OBLAS_CPU_NEON:
+#if defined(__linux__)
+    return (getauxval(AT_HWCAP) & HWCAP_NEON) != 0;
+#else
+    return true;
 #endif
 #endif
+  default:
+    return false;
+  }
+}
+
+// pick the best backend the cpu runs before main, OBLAS_BACKEND=name forces
+// one for benchmarking
+__attribute__((constructor)) static void oblas_init(void) {
+  const char *want = getenv("OBLAS_BACKEND");
+  const oblas_kernels *best = NULL, *forced = NULL;
+
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
 #endif
+  for (size_t b = 0; b < OBLAS_BACKENDS; b++) {
+    if (!oblas_cpu_supports(oblas_backends[b]->cpu))
+      continue;
+    if (!best)
+      best = oblas_backends[b];
+    if (want && strcmp(want, oblas_backends[b]->name) == 0)
+      forced = oblas_backends[b];
+  }
+  if (want && !forced)
+    fprintf(stderr, "oblas: backend %s unavailable, using %s\n", want,
+            best->name);
+  ok = forced ? forced : best;
+}
+
+const char *oblas_backend(void) { return ok->name; }
+
+void ocopy(uint8_t *a, uint8_t *b, size_t i, size_t j, size_t k) {
+  ok->ocopy(a, b, i, j, k);
+}
+
+void oswaprow(uint8_t *a, size_t i, size_t j, size_t k) {
+  ok->oswaprow(a, i, j, k);
+}
+
+void oswapcol(uint8_t *a, size_t i, size_t j, size_t k, size_t l) {
+  ok->oswapcol(a, i, j, k, l);
+}
+
+void oaxpy(uint8_t *a, uint8_t *b, size_t i, size_t j, size_t k, uint8_t u) {
+  ok->oaxpy(a, b, i, j, k, u);
+}
+
+void oaddrow(uint8_t *a, uint8_t *b, size_t i, size_t j, size_t k) {
+  ok->oaddrow(a, b, i, j, k);
+}
+
+void oscal(uint8_t *a, size_t i, size_t k, uint8_t u) {
+  ok->oscal(a, i, k, u);
+}
+
+void ozero(uint8_t *a, size_t i, size_t k) { ok->ozero(a, i, k); }
+
+/* c = a * b in slabs of OBLAS_GEMM_KB rows by OBLAS_GEMM_MB columns of b,
+ * every row of c takes a slab while it is in cache, handing its nonzero
+ * coefficients to the backend's oaxpy_multi */
+void ogemm(uint8_t *a, uint8_t *b, uint8_t *c, size_t n, size_t k, size_t m) {
+  size_t as = ALIGNED_COLS(k), bs = ALIGNED_COLS(m);
+  uint8_t *src[OBLAS_GEMM_KB], u[OBLAS_GEMM_KB];
+
+  for (size_t row = 0; row < n; row++)
+    ok->ozero(c, row, m);
+  for (size_t col = 0; col < bs; col += OBLAS_GEMM_MB) {
+    size_t w = (bs - col < OBLAS_GEMM_MB) ? bs - col : OBLAS_GEMM_MB;
+    for (size_t l = 0; l < k; l += OBLAS_GEMM_KB) {
+      size_t kb = (k - l < OBLAS_GEMM_KB) ? k - l : OBLAS_GEMM_KB;
+      for (size_t row = 0; row < n; row++) {
+        uint8_t *ap = a + row * as + l;
+        size_t cnt = 0;
+        for (size_t idx = 0; idx < kb; idx++) {
+          if (ap[idx] == 0)
+            continue;
+          src[cnt] = b + (l + idx) * bs + col;
+          u[cnt++] = ap[idx];
+        }
+        if (cnt > 0)
+          ok->oaxpy_multi(c + row * bs + col, src, u, cnt, w);
+      }
+    }
+  }
+}
+
+size_t onnz(uint8_t *a, size_t i, size_t s, size_t e, size_t k) {
+  return ok->onnz(a, i, s, e, k);
+}
+
+void oaxpy_b32(uint8_t *a, uint32_t *b, size_t i, size_t k, uint8_t u) {
+  ok->oaxpy_b32(a, b, i, k, u);
+}
+
+void oaxpy_multi(uint8_t *a, uint8_t **b, const uint8_t *u, size_t n,
+                 size_t k) {
+  ok->oaxpy_multi(a, b, u, n, k);
+}
+
+void oaxpy_b8(uint8_t *a, uint8_t *b, size_t i, size_t k, const uint8_t *u) {
+  ok->oaxpy_b8(a, b, i, k, u);
+}
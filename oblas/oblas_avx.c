@@ -1,20 +1,20 @@
 #include <immintrin.h> /* AVX */
 
-#include "oblas.h"
+#include "oblas_kernels.h"
 
-void ocopy(uint8_t *restrict a, uint8_t *restrict b, size_t i, size_t j,
-           size_t k) {
+static void ocopy_avx(uint8_t *restrict a, uint8_t *restrict b, size_t i,
+                      size_t j, size_t k) {
   octet *ap = a + (i * ALIGNED_COLS(k));
   octet *bp = b + (j * ALIGNED_COLS(k));
 
   __m256i *ap256 = (__m256i *)ap;
   __m256i *bp256 = (__m256i *)bp;
-  for (size_t idx = 0; idx < ALIGNED_COLS(k); idx += OCTMAT_ALIGN) {
+  for (size_t idx = 0; idx < ALIGNED_COLS(k); idx += sizeof(__m256i)) {
     _mm256_storeu_si256(ap256++, _mm256_loadu_si256(bp256++));
   }
 }
 
-void oswaprow(uint8_t *restrict a, size_t i, size_t j, size_t k) {
+static void oswaprow_avx(uint8_t *restrict a, size_t i, size_t j, size_t k) {
   if (i == j)
     return;
   octet *ap = a + (i * ALIGNED_COLS(k));
@@ -22,7 +22,7 @@ void oswaprow(uint8_t *restrict a, size_t i, size_t j, size_t k) {
 
   __m256i *ap256 = (__m256i *)ap;
   __m256i *bp256 = (__m256i *)bp;
-  for (size_t idx = 0; idx < ALIGNED_COLS(k); idx += OCTMAT_ALIGN) {
+  for (size_t idx = 0; idx < ALIGNED_COLS(k); idx += sizeof(__m256i)) {
     __m256i atmp = _mm256_loadu_si256((__m256i *)(ap256));
     __m256i btmp = _mm256_loadu_si256((__m256i *)(bp256));
     _mm256_storeu_si256(ap256++, btmp);
@@ -30,7 +30,8 @@ void oswaprow(uint8_t *restrict a, size_t i, size_t j, size_t k) {
   }
 }
 
-void oswapcol(octet *restrict a, size_t i, size_t j, size_t k, size_t l) {
+static void oswapcol_avx(octet *restrict a, size_t i, size_t j, size_t k,
+                         size_t l) {
   if (i == j)
     return;
   octet *ap = a;
@@ -40,8 +41,23 @@ void oswapcol(octet *restrict a, size_t i, size_t j, size_t k, size_t l) {
   }
 }
 
-void oaxpy(uint8_t *restrict a, uint8_t *restrict b, size_t i, size_t j,
-           size_t k, uint8_t u) {
+static void oaddrow_avx(uint8_t *restrict a, uint8_t *restrict b, size_t i,
+                        size_t j, size_t k) {
+  octet *ap = a + (i * ALIGNED_COLS(k));
+  octet *bp = b + (j * ALIGNED_COLS(k));
+
+  __m256i *ap256 = (__m256i *)ap;
+  __m256i *bp256 = (__m256i *)bp;
+  for (size_t idx = 0; idx < ALIGNED_COLS(k); idx += sizeof(__m256i)) {
+    _mm256_storeu_si256(ap256, _mm256_xor_si256(_mm256_loadu_si256(ap256),
+                                                _mm256_loadu_si256(bp256)));
+    ap256++;
+    bp256++;
+  }
+}
+
+static void oaxpy_avx(uint8_t *restrict a, uint8_t *restrict b, size_t i,
+                      size_t j, size_t k, uint8_t u) {
   octet *ap = a + (i * ALIGNED_COLS(k));
   octet *bp = b + (j * ALIGNED_COLS(k));
 
@@ -49,7 +65,7 @@ void oaxpy(uint8_t *restrict a, uint8_t *restrict b, size_t i, size_t j,
     return;
 
   if (u == 1)
-    return oaddrow(a, b, i, j, k);
+    return oaddrow_avx(a, b, i, j, k);
 
   const __m256i mask = _mm256_set1_epi8(0x0f);
   const __m256i urow_hi =
@@ -59,7 +75,7 @@ void oaxpy(uint8_t *restrict a, uint8_t *restrict b, size_t i, size_t j,
 
   __m256i *ap256 = (__m256i *)ap;
   __m256i *bp256 = (__m256i *)bp;
-  for (size_t idx = 0; idx < ALIGNED_COLS(k); idx += OCTMAT_ALIGN) {
+  for (size_t idx = 0; idx < ALIGNED_COLS(k); idx += sizeof(__m256i)) {
     __m256i bx = _mm256_loadu_si256(bp256++);
     __m256i lo = _mm256_and_si256(bx, mask);
     bx = _mm256_srli_epi64(bx, 4);
@@ -73,22 +89,7 @@ void oaxpy(uint8_t *restrict a, uint8_t *restrict b, size_t i, size_t j,
   }
 }
 
-void oaddrow(uint8_t *restrict a, uint8_t *restrict b, size_t i, size_t j,
-             size_t k) {
-  octet *ap = a + (i * ALIGNED_COLS(k));
-  octet *bp = b + (j * ALIGNED_COLS(k));
-
-  __m256i *ap256 = (__m256i *)ap;
-  __m256i *bp256 = (__m256i *)bp;
-  for (size_t idx = 0; idx < ALIGNED_COLS(k); idx += OCTMAT_ALIGN) {
-    _mm256_storeu_si256(ap256, _mm256_xor_si256(_mm256_loadu_si256(ap256),
-                                                _mm256_loadu_si256(bp256)));
-    ap256++;
-    bp256++;
-  }
-}
-
-void oscal(uint8_t *restrict a, size_t i, size_t k, uint8_t u) {
+static void oscal_avx(uint8_t *restrict a, size_t i, size_t k, uint8_t u) {
   octet *ap = a + (i * ALIGNED_COLS(k));
 
   if (u < 2)
@@ -101,7 +102,7 @@ void oscal(uint8_t *restrict a, size_t i, size_t k, uint8_t u) {
       _mm256_loadu2_m128i((__m128i *)OCT_MUL_LO[u], (__m128i *)OCT_MUL_LO[u]);
 
   __m256i *ap256 = (__m256i *)ap;
-  for (size_t idx = 0; idx < ALIGNED_COLS(k); idx += OCTMAT_ALIGN) {
+  for (size_t idx = 0; idx < ALIGNED_COLS(k); idx += sizeof(__m256i)) {
     __m256i ax = _mm256_loadu_si256(ap256);
     __m256i lo = _mm256_and_si256(ax, mask);
     ax = _mm256_srli_epi64(ax, 4);
@@ -113,31 +114,80 @@ void oscal(uint8_t *restrict a, size_t i, size_t k, uint8_t u) {
   }
 }
 
-void ozero(uint8_t *restrict a, size_t i, size_t k) {
+static void ozero_avx(uint8_t *restrict a, size_t i, size_t k) {
   octet *ap = a + (i * ALIGNED_COLS(k));
   __m256i *ap256 = (__m256i *)ap;
   __m256i z256 = _mm256_setzero_si256();
 
-  for (size_t idx = 0; idx < ALIGNED_COLS(k); idx += OCTMAT_ALIGN) {
+  for (size_t idx = 0; idx < ALIGNED_COLS(k); idx += sizeof(__m256i)) {
     _mm256_storeu_si256(ap256++, z256);
   }
 }
 
-void ogemm(uint8_t *restrict a, uint8_t *restrict b, uint8_t *restrict c,
-           size_t n, size_t k, size_t m) {
-  octet *ap, *cp = c;
+#define AVX_MUL(x, lo, hi, mask)                                             \
+  _mm256_xor_si256(_mm256_shuffle_epi8(lo, _mm256_and_si256(x, mask)),         \
+                   _mm256_shuffle_epi8(                                        \
+                       hi, _mm256_and_si256(_mm256_srli_epi64(x, 4), mask)))
+
+#define AVX_TABLE(tab, u)                                                      \
+  _mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i *)(tab)[u]))
 
-  for (size_t row = 0; row < n; row++, cp += ALIGNED_COLS(m)) {
-    ap = a + (row * ALIGNED_COLS(k));
+// four sources per pass, their tables stay in registers across the row
+static void oaxpy_multi4(uint8_t *restrict a, uint8_t **b, const uint8_t *u,
+                         size_t k) {
+  const __m256i mask = _mm256_set1_epi8(0x0f);
+  const __m256i lo0 = AVX_TABLE(OCT_MUL_LO, u[0]);
+  const __m256i hi0 = AVX_TABLE(OCT_MUL_HI, u[0]);
+  const __m256i lo1 = AVX_TABLE(OCT_MUL_LO, u[1]);
+  const __m256i hi1 = AVX_TABLE(OCT_MUL_HI, u[1]);
+  const __m256i lo2 = AVX_TABLE(OCT_MUL_LO, u[2]);
+  const __m256i hi2 = AVX_TABLE(OCT_MUL_HI, u[2]);
+  const __m256i lo3 = AVX_TABLE(OCT_MUL_LO, u[3]);
+  const __m256i hi3 = AVX_TABLE(OCT_MUL_HI, u[3]);
+
+  for (size_t idx = 0; idx < ALIGNED_COLS(k); idx += sizeof(__m256i)) {
+    __m256i *ap256 = (__m256i *)(a + idx);
+    __m256i x0 = _mm256_loadu_si256((__m256i *)(b[0] + idx));
+    __m256i x1 = _mm256_loadu_si256((__m256i *)(b[1] + idx));
+    __m256i x2 = _mm256_loadu_si256((__m256i *)(b[2] + idx));
+    __m256i x3 = _mm256_loadu_si256((__m256i *)(b[3] + idx));
+    __m256i acc = _mm256_xor_si256(AVX_MUL(x0, lo0, hi0, mask),
+                                   AVX_MUL(x1, lo1, hi1, mask));
+    acc = _mm256_xor_si256(acc, AVX_MUL(x2, lo2, hi2, mask));
+    acc = _mm256_xor_si256(acc, AVX_MUL(x3, lo3, hi3, mask));
+    _mm256_storeu_si256(ap256,
+                        _mm256_xor_si256(_mm256_loadu_si256(ap256), acc));
+  }
+}
 
-    ozero(cp, 0, m);
-    for (size_t idx = 0; idx < k; idx++) {
-      oaxpy(cp, b, 0, idx, m, ap[idx]);
-    }
+static void oaddrow4(uint8_t *restrict a, uint8_t **b, size_t k) {
+  for (size_t idx = 0; idx < ALIGNED_COLS(k); idx += sizeof(__m256i)) {
+    __m256i *ap256 = (__m256i *)(a + idx);
+    __m256i acc =
+        _mm256_xor_si256(_mm256_loadu_si256((__m256i *)(b[0] + idx)),
+                         _mm256_loadu_si256((__m256i *)(b[1] + idx)));
+    acc = _mm256_xor_si256(acc, _mm256_loadu_si256((__m256i *)(b[2] + idx)));
+    acc = _mm256_xor_si256(acc, _mm256_loadu_si256((__m256i *)(b[3] + idx)));
+    _mm256_storeu_si256(ap256,
+                        _mm256_xor_si256(_mm256_loadu_si256(ap256), acc));
   }
 }
 
-size_t onnz(uint8_t *a, size_t i, size_t s, size_t e, size_t k) {
+static void oaxpy_multi_avx(uint8_t *restrict a, uint8_t **b, const uint8_t *u,
+                            size_t n, size_t k) {
+  size_t s = 0;
+  for (; s + 4 <= n; s += 4) {
+    if ((u[s] & u[s + 1] & u[s + 2] & u[s + 3]) == 1 &&
+        (u[s] | u[s + 1] | u[s + 2] | u[s + 3]) == 1)
+      oaddrow4(a, b + s, k);
+    else
+      oaxpy_multi4(a, b + s, u + s, k);
+  }
+  for (; s < n; s++)
+    oaxpy_avx(a, b[s], 0, 0, k, u[s]);
+}
+
+static size_t onnz_avx(uint8_t *a, size_t i, size_t s, size_t e, size_t k) {
   octet *ap = a + (i * ALIGNED_COLS(k));
   size_t nz = 0;
   for (size_t idx = s; idx < e; idx++) {
@@ -146,7 +196,8 @@ size_t onnz(uint8_t *a, size_t i, size_t s, size_t e, size_t k) {
   return nz;
 }
 
-void oaxpy_b32(uint8_t *a, uint32_t *b, size_t i, size_t k, uint8_t u) {
+static void oaxpy_b32_avx(uint8_t *a, uint32_t *b, size_t i, size_t k,
+                          uint8_t u) {
   __m256i *ap256 = (__m256i *)(a + i * ALIGNED_COLS(k));
   __m256i scatter =
       _mm256_set_epi32(0x03030303, 0x03030303, 0x02020202, 0x02020202,
@@ -168,3 +219,37 @@ void oaxpy_b32(uint8_t *a, uint32_t *b, size_t i, size_t k, uint8_t u) {
                         _mm256_xor_si256(_mm256_loadu_si256(ap256), bytes));
   }
 }
+
+static void oaxpy_b8_avx(uint8_t *restrict a, uint8_t *restrict b, size_t i,
+                         size_t k, const uint8_t *u) {
+  octet *ap = a + (i * ALIGNED_COLS(k)), lo8[16], hi8[16];
+
+  OBLAS_B8_TABLES(lo8, hi8, u);
+  const __m256i mask = _mm256_set1_epi8(0x0f);
+  const __m256i lo =
+      _mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i *)lo8));
+  const __m256i hi =
+      _mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i *)hi8));
+  for (size_t idx = 0; idx < ALIGNED_COLS(k); idx += sizeof(__m256i)) {
+    __m256i *ap256 = (__m256i *)(ap + idx);
+    __m256i bx =
+        AVX_MUL(_mm256_loadu_si256((__m256i *)(b + idx)), lo, hi, mask);
+    _mm256_storeu_si256(ap256, _mm256_xor_si256(_mm256_loadu_si256(ap256), bx));
+  }
+}
+
+const oblas_kernels oblas_avx = {
+    .name = "avx2",
+    .cpu = OBLAS_CPU_AVX2,
+    .ocopy = ocopy_avx,
+    .oswaprow = oswaprow_avx,
+    .oswapcol = oswapcol_avx,
+    .oaxpy = oaxpy_avx,
+    .oaddrow = oaddrow_avx,
+    .oscal = oscal_avx,
+    .ozero = ozero_avx,
+    .onnz = onnz_avx,
+    .oaxpy_b32 = oaxpy_b32_avx,
+    .oaxpy_multi = oaxpy_multi_avx,
+    .oaxpy_b8 = oaxpy_b8_avx,
+};
@@ -1,62 +1,292 @@
-#include <immintrin.h> /* AVX512 */
-
-void oblas_axpy(uint8_t *a, const uint8_t *b, size_t k, const uint8_t *u_lo,
-                const uint8_t *u_hi) {
-  const __m512i mask = _mm512_set1_epi8(0x0f);
-  const __m128i ulo_128 = _mm_loadu_si128((__m128i *)u_lo);
-  const __m128i uhi_128 = _mm_loadu_si128((__m128i *)u_hi);
-  const __m512i urow_lo = _mm512_broadcast_i32x4(ulo_128);
-  const __m512i urow_hi = _mm512_broadcast_i32x4(uhi_128);
-  __m512i *ap = (__m512i *)a, *ae = (__m512i *)(a + k);
-  __m512i *bp = (__m512i *)b;
-  for (; ap < ae; ap++, bp++) {
-    __m512i bx = _mm512_loadu_si512(bp);
-    __m512i lo = _mm512_and_si512(bx, mask);
-    bx = _mm512_srli_epi64(bx, 4);
-    __m512i hi = _mm512_and_si512(bx, mask);
-    lo = _mm512_shuffle_epi8(urow_lo, lo);
-    hi = _mm512_shuffle_epi8(urow_hi, hi);
-    _mm512_storeu_si512(
-        ap, _mm512_xor_si512(_mm512_loadu_si512(ap), _mm512_xor_si512(lo, hi)));
-  }
-}
-
-void oblas_scal(uint8_t *a, size_t k, const uint8_t *u_lo,
-                const uint8_t *u_hi) {
-  const __m512i mask = _mm512_set1_epi8(0x0f);
-  const __m128i ulo_128 = _mm_loadu_si128((__m128i *)u_lo);
-  const __m128i uhi_128 = _mm_loadu_si128((__m128i *)u_hi);
-  const __m512i urow_lo = _mm512_broadcast_i32x4(ulo_128);
-  const __m512i urow_hi = _mm512_broadcast_i32x4(uhi_128);
-  __m512i *ap = (__m512i *)a, *ae = (__m512i *)(a + k);
-  for (; ap < ae; ap++) {
-    __m512i ax = _mm512_loadu_si512(ap);
-    __m512i lo = _mm512_and_si512(ax, mask);
-    ax = _mm512_srli_epi64(ax, 4);
-    __m512i hi = _mm512_and_si512(ax, mask);
-    lo = _mm512_shuffle_epi8(urow_lo, lo);
-    hi = _mm512_shuffle_epi8(urow_hi, hi);
-    _mm512_storeu_si512(ap, _mm512_xor_si512(lo, hi));
-  }
-}
-
-void oblas_axpy_gf2_gf256_32(uint8_t *a, uint32_t *b, size_t k, uint8_t u) {
-  __m512i *ap = (__m512i *)a, *ae = (__m512i *)(a + k);
-  __m512i scatter = _mm512_set_epi32(
-      0x03030303, 0x03030303, 0x02020202, 0x02020202, 0x01010101, 0x01010101,
-      0x00000000, 0x00000000, 0x03030303, 0x03030303, 0x02020202, 0x02020202,
-      0x01010101, 0x01010101, 0x00000000, 0x00000000);
-  __m512i cmpmask = _mm512_set_epi32(
-      0x80402010, 0x08040201, 0x80402010, 0x08040201, 0x80402010, 0x08040201,
-      0x80402010, 0x08040201, 0x80402010, 0x08040201, 0x80402010, 0x08040201,
-      0x80402010, 0x08040201, 0x80402010, 0x08040201);
-  __m512i up = _mm512_set1_epi8(u);
-  for (unsigned p = 0; ap < ae; p++, ap++) {
-    __m512i bcast = _mm512_set1_epi32(b[p]);
-    __m512i ret = _mm512_shuffle_epi8(bcast, scatter);
-    ret = _mm512_andnot_si512(ret, cmpmask);
-    __mmask64 tmp = _mm512_cmpeq_epi8_mask(ret, _mm512_setzero_si512());
-    ret = _mm512_mask_blend_epi8(tmp, _mm512_setzero_si512(), up);
-    _mm512_storeu_si512(ap, _mm512_xor_si512(_mm512_loadu_si512(ap), ret));
+#include <immintrin.h> /* AVX512BW, GFNI */
+
+#include "oblas_kernels.h"
+
+/*
+ * Rows are only padded to OCTMAT_ALIGN (32), so after the 64 byte steps a
+ * row may have one 32 byte step left, done with the VEX forms. Masked 64
+ * byte steps measured twice as slow on short rows.
+ */
+#define AVX512_FULL(idx, k) ((idx) + sizeof(__m512i) <= ALIGNED_COLS(k))
+
+/*
+ * Multiplication by a constant is GF(2) linear, so with GFNI it is one
+ * affine transform by the bit matrix of u. GF2P8MULB can not be used as it
+ * reduces by 0x11B rather than the 0x11D of RaptorQ.
+ */
+#ifdef OBLAS_AVX512_GFNI
+#define AVX512_MUL_TABLE(t, u)                                                 \
+  const __m512i t = _mm512_set1_epi64(OCT_MUL_AFFINE[u])
+#define AVX512_MUL(x, t) _mm512_gf2p8affine_epi64_epi8(x, t, 0)
+#define AVX512_MUL256(x, t)                                                    \
+  _mm256_gf2p8affine_epi64_epi8(x, _mm512_castsi512_si256(t), 0)
+#else
+#define AVX512_MUL_TABLE(t, u)                                                 \
+  const __m512i t##_lo =                                                       \
+      _mm512_broadcast_i32x4(_mm_loadu_si128((__m128i *)OCT_MUL_LO[u]));       \
+  const __m512i t##_hi =                                                       \
+      _mm512_broadcast_i32x4(_mm_loadu_si128((__m128i *)OCT_MUL_HI[u]))
+#define AVX512_MUL(x, t)                                                       \
+  _mm512_xor_si512(                                                            \
+      _mm512_shuffle_epi8(t##_lo,                                              \
+                          _mm512_and_si512(x, _mm512_set1_epi8(0x0f))),        \
+      _mm512_shuffle_epi8(t##_hi,                                              \
+                          _mm512_and_si512(_mm512_srli_epi64(x, 4),            \
+                                           _mm512_set1_epi8(0x0f))))
+#define AVX512_MUL256(x, t)                                                    \
+  _mm256_xor_si256(                                                            \
+      _mm256_shuffle_epi8(_mm512_castsi512_si256(t##_lo),                      \
+                          _mm256_and_si256(x, _mm256_set1_epi8(0x0f))),        \
+      _mm256_shuffle_epi8(_mm512_castsi512_si256(t##_hi),                      \
+                          _mm256_and_si256(_mm256_srli_epi64(x, 4),            \
+                                           _mm256_set1_epi8(0x0f))))
+#endif
+
+#define LD512(p) _mm512_loadu_si512(p)
+#define ST512(p, x) _mm512_storeu_si512(p, x)
+#define LD256(p) _mm256_loadu_si256((__m256i *)(p))
+#define ST256(p, x) _mm256_storeu_si256((__m256i *)(p), x)
+
+static void ocopy_avx512(uint8_t *restrict a, uint8_t *restrict b, size_t i,
+                         size_t j, size_t k) {
+  octet *ap = a + (i * ALIGNED_COLS(k));
+  octet *bp = b + (j * ALIGNED_COLS(k));
+  size_t idx = 0;
+
+  for (; AVX512_FULL(idx, k); idx += sizeof(__m512i))
+    ST512(ap + idx, LD512(bp + idx));
+  if (idx < ALIGNED_COLS(k))
+    ST256(ap + idx, LD256(bp + idx));
+}
+
+static void oswaprow_avx512(uint8_t *restrict a, size_t i, size_t j,
+                            size_t k) {
+  if (i == j)
+    return;
+  octet *ap = a + (i * ALIGNED_COLS(k));
+  octet *bp = a + (j * ALIGNED_COLS(k));
+  size_t idx = 0;
+
+  for (; AVX512_FULL(idx, k); idx += sizeof(__m512i)) {
+    __m512i atmp = LD512(ap + idx), btmp = LD512(bp + idx);
+    ST512(ap + idx, btmp);
+    ST512(bp + idx, atmp);
+  }
+  if (idx < ALIGNED_COLS(k)) {
+    __m256i atmp = LD256(ap + idx), btmp = LD256(bp + idx);
+    ST256(ap + idx, btmp);
+    ST256(bp + idx, atmp);
+  }
+}
+
+static void oswapcol_avx512(octet *restrict a, size_t i, size_t j, size_t k,
+                            size_t l) {
+  if (i == j)
+    return;
+  octet *ap = a;
+
+  for (size_t idx = 0; idx < k; idx++, ap += ALIGNED_COLS(l)) {
+    OCTET_SWAP(ap[i], ap[j]);
+  }
+}
+
+static void oaddrow_avx512(uint8_t *restrict a, uint8_t *restrict b, size_t i,
+                           size_t j, size_t k) {
+  octet *ap = a + (i * ALIGNED_COLS(k));
+  octet *bp = b + (j * ALIGNED_COLS(k));
+  size_t idx = 0;
+
+  for (; AVX512_FULL(idx, k); idx += sizeof(__m512i))
+    ST512(ap + idx, _mm512_xor_si512(LD512(ap + idx), LD512(bp + idx)));
+  if (idx < ALIGNED_COLS(k))
+    ST256(ap + idx, _mm256_xor_si256(LD256(ap + idx), LD256(bp + idx)));
+}
+
+static void oaxpy_avx512(uint8_t *restrict a, uint8_t *restrict b, size_t i,
+                         size_t j, size_t k, uint8_t u) {
+  octet *ap = a + (i * ALIGNED_COLS(k));
+  octet *bp = b + (j * ALIGNED_COLS(k));
+  size_t idx = 0;
+
+  if (u == 0)
+    return;
+
+  if (u == 1)
+    return oaddrow_avx512(a, b, i, j, k);
+
+  AVX512_MUL_TABLE(urow, u);
+  for (; AVX512_FULL(idx, k); idx += sizeof(__m512i)) {
+    __m512i bx = AVX512_MUL(LD512(bp + idx), urow);
+    ST512(ap + idx, _mm512_xor_si512(LD512(ap + idx), bx));
+  }
+  if (idx < ALIGNED_COLS(k)) {
+    __m256i bx = AVX512_MUL256(LD256(bp + idx), urow);
+    ST256(ap + idx, _mm256_xor_si256(LD256(ap + idx), bx));
+  }
+}
+
+static void oscal_avx512(uint8_t *restrict a, size_t i, size_t k, uint8_t u) {
+  octet *ap = a + (i * ALIGNED_COLS(k));
+  size_t idx = 0;
+
+  if (u < 2)
+    return;
+
+  AVX512_MUL_TABLE(urow, u);
+  for (; AVX512_FULL(idx, k); idx += sizeof(__m512i))
+    ST512(ap + idx, AVX512_MUL(LD512(ap + idx), urow));
+  if (idx < ALIGNED_COLS(k))
+    ST256(ap + idx, AVX512_MUL256(LD256(ap + idx), urow));
+}
+
+static void ozero_avx512(uint8_t *restrict a, size_t i, size_t k) {
+  octet *ap = a + (i * ALIGNED_COLS(k));
+  size_t idx = 0;
+
+  for (; AVX512_FULL(idx, k); idx += sizeof(__m512i))
+    ST512(ap + idx, _mm512_setzero_si512());
+  if (idx < ALIGNED_COLS(k))
+    ST256(ap + idx, _mm256_setzero_si256());
+}
+
+// four sources per pass, their tables stay in registers across the row
+static void oaxpy_multi4(uint8_t *restrict a, uint8_t **b, const uint8_t *u,
+                         size_t k) {
+  size_t idx = 0;
+  AVX512_MUL_TABLE(t0, u[0]);
+  AVX512_MUL_TABLE(t1, u[1]);
+  AVX512_MUL_TABLE(t2, u[2]);
+  AVX512_MUL_TABLE(t3, u[3]);
+
+  for (; AVX512_FULL(idx, k); idx += sizeof(__m512i)) {
+    __m512i acc = _mm512_xor_si512(AVX512_MUL(LD512(b[0] + idx), t0),
+                                   AVX512_MUL(LD512(b[1] + idx), t1));
+    acc = _mm512_xor_si512(acc, AVX512_MUL(LD512(b[2] + idx), t2));
+    acc = _mm512_xor_si512(acc, AVX512_MUL(LD512(b[3] + idx), t3));
+    ST512(a + idx, _mm512_xor_si512(LD512(a + idx), acc));
+  }
+  if (idx < ALIGNED_COLS(k)) {
+    __m256i acc = _mm256_xor_si256(AVX512_MUL256(LD256(b[0] + idx), t0),
+                                   AVX512_MUL256(LD256(b[1] + idx), t1));
+    acc = _mm256_xor_si256(acc, AVX512_MUL256(LD256(b[2] + idx), t2));
+    acc = _mm256_xor_si256(acc, AVX512_MUL256(LD256(b[3] + idx), t3));
+    ST256(a + idx, _mm256_xor_si256(LD256(a + idx), acc));
+  }
+}
+
+static void oaddrow4(uint8_t *restrict a, uint8_t **b, size_t k) {
+  size_t idx = 0;
+
+  for (; AVX512_FULL(idx, k); idx += sizeof(__m512i)) {
+    __m512i acc = _mm512_xor_si512(LD512(b[0] + idx), LD512(b[1] + idx));
+    acc = _mm512_xor_si512(acc, LD512(b[2] + idx));
+    acc = _mm512_xor_si512(acc, LD512(b[3] + idx));
+    ST512(a + idx, _mm512_xor_si512(LD512(a + idx), acc));
+  }
+  if (idx < ALIGNED_COLS(k)) {
+    __m256i acc = _mm256_xor_si256(LD256(b[0] + idx), LD256(b[1] + idx));
+    acc = _mm256_xor_si256(acc, LD256(b[2] + idx));
+    acc = _mm256_xor_si256(acc, LD256(b[3] + idx));
+    ST256(a + idx, _mm256_xor_si256(LD256(a + idx), acc));
+  }
+}
+
+static void oaxpy_multi_avx512(uint8_t *restrict a, uint8_t **b,
+                               const uint8_t *u, size_t n, size_t k) {
+  size_t s = 0;
+  for (; s + 4 <= n; s += 4) {
+    if ((u[s] & u[s + 1] & u[s + 2] & u[s + 3]) == 1 &&
+        (u[s] | u[s + 1] | u[s + 2] | u[s + 3]) == 1)
+      oaddrow4(a, b + s, k);
+    else
+      oaxpy_multi4(a, b + s, u + s, k);
+  }
+  for (; s < n; s++)
+    oaxpy_avx512(a, b[s], 0, 0, k, u[s]);
+}
+
+static size_t onnz_avx512(uint8_t *a, size_t i, size_t s, size_t e,
+                          size_t k) {
+  octet *ap = a + (i * ALIGNED_COLS(k));
+  size_t nz = 0;
+  for (size_t idx = s; idx < e; idx++) {
+    nz += (ap[idx] != 0);
+  }
+  return nz;
+}
+
+// the bits of two words select which of 64 bytes get u added
+static void oaxpy_b32_avx512(uint8_t *a, uint32_t *b, size_t i, size_t k,
+                             uint8_t u) {
+  octet *ap = a + (i * ALIGNED_COLS(k));
+  const __m512i up = _mm512_set1_epi8(u);
+
+  for (size_t idx = 0, p = 0; idx < k; idx += sizeof(__m512i), p += 2) {
+    __mmask64 m = b[p];
+    if (idx + 8 * sizeof(uint32_t) < k)
+      m |= (__mmask64)b[p + 1] << 32;
+    __m512i ax = _mm512_maskz_loadu_epi8(m, ap + idx);
+    _mm512_mask_storeu_epi8(ap + idx, m, _mm512_xor_si512(ax, up));
   }
 }
+
+#ifdef OBLAS_AVX512_GFNI
+// byte 7 - r of the bit matrix holds bit r of every u[s] at bit s
+static uint64_t b8_affine(const uint8_t *u) {
+  uint64_t m = 0;
+  for (int r = 0; r < 8; r++) {
+    uint64_t row = 0;
+    for (int s = 0; s < 8; s++)
+      row |= (uint64_t)((u[s] >> r) & 1) << s;
+    m |= row << (8 * (7 - r));
+  }
+  return m;
+}
+#define AVX512_B8_TABLE(t, u) const __m512i t = _mm512_set1_epi64(b8_affine(u))
+#else
+#define AVX512_B8_TABLE(t, u)                                                  \
+  octet t##_lo8[16], t##_hi8[16];                                              \
+  OBLAS_B8_TABLES(t##_lo8, t##_hi8, u);                                        \
+  const __m512i t##_lo =                                                       \
+      _mm512_broadcast_i32x4(_mm_loadu_si128((__m128i *)t##_lo8));             \
+  const __m512i t##_hi =                                                       \
+      _mm512_broadcast_i32x4(_mm_loadu_si128((__m128i *)t##_hi8))
+#endif
+
+static void oaxpy_b8_avx512(uint8_t *restrict a, uint8_t *restrict b,
+                            size_t i, size_t k, const uint8_t *u) {
+  octet *ap = a + (i * ALIGNED_COLS(k));
+  size_t idx = 0;
+
+  AVX512_B8_TABLE(urow, u);
+  for (; AVX512_FULL(idx, k); idx += sizeof(__m512i)) {
+    __m512i bx = AVX512_MUL(LD512(b + idx), urow);
+    ST512(ap + idx, _mm512_xor_si512(LD512(ap + idx), bx));
+  }
+  if (idx < ALIGNED_COLS(k)) {
+    __m256i bx = AVX512_MUL256(LD256(b + idx), urow);
+    ST256(ap + idx, _mm256_xor_si256(LD256(ap + idx), bx));
+  }
+}
+
+#ifdef OBLAS_AVX512_GFNI
+const oblas_kernels oblas_gfni = {
+    .name = "gfni",
+    .cpu = OBLAS_CPU_GFNI,
+#else
+const oblas_kernels oblas_avx512 = {
+    .name = "avx512",
+    .cpu = OBLAS_CPU_AVX512BW,
+#endif
+    .ocopy = ocopy_avx512,
+    .oswaprow = oswaprow_avx512,
+    .oswapcol = oswapcol_avx512,
+    .oaxpy = oaxpy_avx512,
+    .oaddrow = oaddrow_avx512,
+    .oscal = oscal_avx512,
+    .ozero = ozero_avx512,
+    .onnz = onnz_avx512,
+    .oaxpy_b32 = oaxpy_b32_avx512,
+    .oaxpy_multi = oaxpy_multi_avx512,
+    .oaxpy_b8 = oaxpy_b8_avx512,
+};
@@ -1,7 +1,7 @@
-#include "oblas.h"
+#include "oblas_kernels.h"
 
-void ocopy(uint8_t *restrict a, uint8_t *restrict b, size_t i, size_t j,
-           size_t k) {
+static void ocopy_classic(uint8_t *restrict a, uint8_t *restrict b, size_t i,
+                          size_t j, size_t k) {
   octet *ap = a + (i * ALIGNED_COLS(k));
   octet *bp = b + (j * ALIGNED_COLS(k));
 
@@ -10,7 +10,8 @@ void ocopy(uint8_t *restrict a, uint8_t *restrict b, size_t i, size_t j,
   }
 }
 
-void oswaprow(uint8_t *restrict a, size_t i, size_t j, size_t k) {
+static void oswaprow_classic(uint8_t *restrict a, size_t i, size_t j,
+                             size_t k) {
   if (i == j)
     return;
   octet *ap = a + (i * ALIGNED_COLS(k));
@@ -21,7 +22,8 @@ void oswaprow(uint8_t *restrict a, size_t i, size_t j, size_t k) {
   }
 }
 
-void oswapcol(octet *restrict a, size_t i, size_t j, size_t k, size_t l) {
+static void oswapcol_classic(octet *restrict a, size_t i, size_t j, size_t k,
+                             size_t l) {
   if (i == j)
     return;
   octet *ap = a;
@@ -31,8 +33,18 @@ void oswapcol(octet *restrict a, size_t i, size_t j, size_t k, size_t l) {
   }
 }
 
-void oaxpy(uint8_t *restrict a, uint8_t *restrict b, size_t i, size_t j,
-           size_t k, uint8_t u) {
+static void oaddrow_classic(uint8_t *restrict a, uint8_t *restrict b, size_t i,
+                            size_t j, size_t k) {
+  octet *ap = a + (i * ALIGNED_COLS(k));
+  octet *bp = b + (j * ALIGNED_COLS(k));
+
+  for (size_t idx = 0; idx < k; idx++) {
+    ap[idx] ^= bp[idx];
+  }
+}
+
+static void oaxpy_classic(uint8_t *restrict a, uint8_t *restrict b, size_t i,
+                          size_t j, size_t k, uint8_t u) {
   octet *ap = a + (i * ALIGNED_COLS(k));
   octet *bp = b + (j * ALIGNED_COLS(k));
 
@@ -40,7 +52,7 @@ void oaxpy(uint8_t *restrict a, uint8_t *restrict b, size_t i, size_t j,
     return;
 
   if (u == 1)
-    return oaddrow(a, b, i, j, k);
+    return oaddrow_classic(a, b, i, j, k);
 
   const octet *urow_hi = OCT_MUL_HI[u];
   const octet *urow_lo = OCT_MUL_LO[u];
@@ -51,17 +63,7 @@ void oaxpy(uint8_t *restrict a, uint8_t *restrict b, size_t i, size_t j,
   }
 }
 
-void oaddrow(uint8_t *restrict a, uint8_t *restrict b, size_t i, size_t j,
-             size_t k) {
-  octet *ap = a + (i * ALIGNED_COLS(k));
-  octet *bp = b + (j * ALIGNED_COLS(k));
-
-  for (size_t idx = 0; idx < k; idx++) {
-    ap[idx] ^= bp[idx];
-  }
-}
-
-void oscal(uint8_t *restrict a, size_t i, size_t k, uint8_t u) {
+static void oscal_classic(uint8_t *restrict a, size_t i, size_t k, uint8_t u) {
   octet *ap = a + (i * ALIGNED_COLS(k));
 
   if (u < 2)
@@ -76,27 +78,25 @@ void oscal(uint8_t *restrict a, size_t i, size_t k, uint8_t u) {
   }
 }
 
-void ozero(uint8_t *restrict a, size_t i, size_t k) {
+static void ozero_classic(uint8_t *restrict a, size_t i, size_t k) {
   octet *ap = a + (i * ALIGNED_COLS(k));
   for (size_t idx = 0; idx < k; idx++)
     ap[idx] = 0;
 }
 
-void ogemm(uint8_t *restrict a, uint8_t *restrict b, uint8_t *restrict c,
-           size_t n, size_t k, size_t m) {
-  octet *ap, *cp = c;
-
-  for (size_t row = 0; row < n; row++, cp += ALIGNED_COLS(m)) {
-    ap = a + (row * ALIGNED_COLS(k));
-
-    ozero(cp, 0, m);
-    for (size_t idx = 0; idx < k; idx++) {
-      oaxpy(cp, b, 0, idx, m, ap[idx]);
+static void oaxpy_multi_classic(uint8_t *restrict a, uint8_t **b,
+                                const uint8_t *u, size_t n, size_t k) {
+  for (size_t idx = 0; idx < k; idx++) {
+    octet acc = a[idx];
+    for (size_t s = 0; s < n; s++) {
+      octet bx = b[s][idx];
+      acc ^= OCT_MUL_HI[u[s]][bx >> 4] ^ OCT_MUL_LO[u[s]][bx & 0x0f];
     }
+    a[idx] = acc;
   }
 }
 
-size_t onnz(uint8_t *a, size_t i, size_t s, size_t e, size_t k) {
+static size_t onnz_classic(uint8_t *a, size_t i, size_t s, size_t e, size_t k) {
   octet *ap = a + (i * ALIGNED_COLS(k));
   size_t nz = 0;
   for (size_t idx = s; idx < e; idx++) {
@@ -105,7 +105,8 @@ size_t onnz(uint8_t *a, size_t i, size_t s, size_t e, size_t k) {
   return nz;
 }
 
-void oaxpy_b32(uint8_t *a, uint32_t *b, size_t i, size_t k, uint8_t u) {
+static void oaxpy_b32_classic(uint8_t *a, uint32_t *b, size_t i, size_t k,
+                              uint8_t u) {
   octet *ap = a + (i * ALIGNED_COLS(k));
   for (size_t idx = 0, p = 0; idx < k; idx += 8 * sizeof(uint32_t), p++) {
     uint32_t tmp = b[p];
@@ -116,3 +117,28 @@ void oaxpy_b32(uint8_t *a, uint32_t *b, size_t i, size_t k, uint8_t u) {
     }
   }
 }
+
+static void oaxpy_b8_classic(uint8_t *restrict a, uint8_t *restrict b,
+                             size_t i, size_t k, const uint8_t *u) {
+  octet *ap = a + (i * ALIGNED_COLS(k)), lo[16], hi[16];
+
+  OBLAS_B8_TABLES(lo, hi, u);
+  for (size_t idx = 0; idx < k; idx++)
+    ap[idx] ^= lo[b[idx] & 0x0f] ^ hi[b[idx] >> 4];
+}
+
+const oblas_kernels oblas_classic = {
+    .name = "classic",
+    .cpu = OBLAS_CPU_ANY,
+    .ocopy = ocopy_classic,
+    .oswaprow = oswaprow_classic,
+    .oswapcol = oswapcol_classic,
+    .oaxpy = oaxpy_classic,
+    .oaddrow = oaddrow_classic,
+    .oscal = oscal_classic,
+    .ozero = ozero_classic,
+    .onnz = onnz_classic,
+    .oaxpy_b32 = oaxpy_b32_classic,
+    .oaxpy_multi = oaxpy_multi_classic,
+    .oaxpy_b8 = oaxpy_b8_classic,
+};
@@ -0,0 +1,3 @@
+// the AVX-512 kernels with multiplies done by GFNI affine transforms
+#define OBLAS_AVX512_GFNI
+#include "oblas_avx512.c"
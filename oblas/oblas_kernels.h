@@ -0,0 +1,58 @@
+#ifndef OBLAS_KERNELS_H
+#define OBLAS_KERNELS_H
+
+#include "oblas.h"
+
+// cpu feature a backend needs, checked before oblas.c dispatches to it
+typedef enum {
+  OBLAS_CPU_ANY,
+  OBLAS_CPU_SSSE3,
+  OBLAS_CPU_AVX2,
+  OBLAS_CPU_AVX512BW,
+  OBLAS_CPU_GFNI, /* with AVX512BW */
+  OBLAS_CPU_NEON,
+} oblas_cpu;
+
+// one backend's implementation of the oblas.h kernels
+typedef struct {
+  const char *name;
+  oblas_cpu cpu;
+  void (*ocopy)(uint8_t *a, uint8_t *b, size_t i, size_t j, size_t k);
+  void (*oswaprow)(uint8_t *a, size_t i, size_t j, size_t k);
+  void (*oswapcol)(uint8_t *a, size_t i, size_t j, size_t k, size_t l);
+  void (*oaxpy)(uint8_t *a, uint8_t *b, size_t i, size_t j, size_t k,
+                uint8_t u);
+  void (*oaddrow)(uint8_t *a, uint8_t *b, size_t i, size_t j, size_t k);
+  void (*oscal)(uint8_t *a, size_t i, size_t k, uint8_t u);
+  void (*ozero)(uint8_t *a, size_t i, size_t k);
+  size_t (*onnz)(uint8_t *a, size_t i, size_t s, size_t e, size_t k);
+  void (*oaxpy_b32)(uint8_t *a, uint32_t *b, size_t i, size_t k, uint8_t u);
+  void (*oaxpy_multi)(uint8_t *a, uint8_t **b, const uint8_t *u, size_t n,
+                      size_t k);
+  void (*oaxpy_b8)(uint8_t *a, uint8_t *b, size_t i, size_t k,
+                   const uint8_t *u);
+} oblas_kernels;
+
+// b of oaxpy_b8 packs eight gf2 rows per byte, lo and hi get the sums of
+// u[0..3] and u[4..7] picked by each nibble
+#define OBLAS_B8_TABLES(lo, hi, u)                                             \
+  do {                                                                         \
+    (lo)[0] = (hi)[0] = 0;                                                     \
+    for (unsigned v_ = 1; v_ < 16; v_++) {                                     \
+      (lo)[v_] = (lo)[v_ & (v_ - 1)] ^ (u)[__builtin_ctz(v_)];                 \
+      (hi)[v_] = (hi)[v_ & (v_ - 1)] ^ (u)[4 + __builtin_ctz(v_)];             \
+    }                                                                          \
+  } while (0)
+
+extern const oblas_kernels oblas_classic;
+#if defined(__x86_64__) || defined(__i386__)
+extern const oblas_kernels oblas_sse;
+extern const oblas_kernels oblas_avx;
+extern const oblas_kernels oblas_avx512;
+extern const oblas_kernels oblas_gfni;
+#endif
+#if defined(__aarch64__) || defined(__ARM_NEON)
+extern const oblas_kernels oblas_neon;
+#endif
+
+#endif
@@ -1,6 +1,6 @@
 #include <arm_neon.h>
 
-#include "oblas.h"
+#include "oblas_kernels.h"
 
 /*
  * AArch32 does not provide this intrinsic natively because it does not
@@ -20,23 +20,23 @@ static uint8x16_t vqtbl1q_u8(uint8x16_t a, uint8x16_t b) {
 }
 #endif
 
-void ocopy(uint8_t *restrict a, uint8_t *restrict b, size_t i, size_t j,
-           size_t k) {
+static void ocopy_neon(uint8_t *restrict a, uint8_t *restrict b, size_t i,
+                       size_t j, size_t k) {
   octet *ap = a + (i * ALIGNED_COLS(k));
   octet *bp = b + (j * ALIGNED_COLS(k));
 
-  for (size_t idx = 0; idx < ALIGNED_COLS(k); idx += OCTMAT_ALIGN) {
+  for (size_t idx = 0; idx < ALIGNED_COLS(k); idx += sizeof(uint8x16_t)) {
     vst1q_u8(ap + idx, vld1q_u8(bp + idx));
   }
 }
 
-void oswaprow(uint8_t *restrict a, size_t i, size_t j, size_t k) {
+static void oswaprow_neon(uint8_t *restrict a, size_t i, size_t j, size_t k) {
   if (i == j)
     return;
   octet *ap = a + (i * ALIGNED_COLS(k));
   octet *bp = a + (j * ALIGNED_COLS(k));
 
-  for (size_t idx = 0; idx < ALIGNED_COLS(k); idx += OCTMAT_ALIGN) {
+  for (size_t idx = 0; idx < ALIGNED_COLS(k); idx += sizeof(uint8x16_t)) {
     uint8x16_t atmp = vld1q_u8(ap + idx);
     uint8x16_t btmp = vld1q_u8(bp + idx);
 
@@ -45,7 +45,8 @@ void oswaprow(uint8_t *restrict a, size_t i, size_t j, size_t k) {
   }
 }
 
-void oswapcol(octet *restrict a, size_t i, size_t j, size_t k, size_t l) {
+static void oswapcol_neon(octet *restrict a, size_t i, size_t j, size_t k,
+                          size_t l) {
   if (i == j)
     return;
   octet *ap = a;
@@ -55,8 +56,21 @@ void oswapcol(octet *restrict a, size_t i, size_t j, size_t k, size_t l) {
   }
 }
 
-void oaxpy(uint8_t *restrict a, uint8_t *restrict b, size_t i, size_t j,
-           size_t k, uint8_t u) {
+static void oaddrow_neon(uint8_t *restrict a, uint8_t *restrict b, size_t i,
+                         size_t j, size_t k) {
+  octet *ap = a + (i * ALIGNED_COLS(k));
+  octet *bp = b + (j * ALIGNED_COLS(k));
+
+  for (size_t idx = 0; idx < ALIGNED_COLS(k); idx += sizeof(uint8x16_t)) {
+    uint8x16_t ap128 = vld1q_u8(ap + idx);
+    uint8x16_t bp128 = vld1q_u8(bp + idx);
+
+    vst1q_u8(ap + idx, veorq_u8(ap128, bp128));
+  }
+}
+
+static void oaxpy_neon(uint8_t *restrict a, uint8_t *restrict b, size_t i,
+                       size_t j, size_t k, uint8_t u) {
   octet *ap = a + (i * ALIGNED_COLS(k));
   octet *bp = b + (j * ALIGNED_COLS(k));
 
@@ -64,12 +78,12 @@ void oaxpy(uint8_t *restrict a, uint8_t *restrict b, size_t i, size_t j,
     return;
 
   if (u == 1)
-    return oaddrow(a, b, i, j, k);
+    return oaddrow_neon(a, b, i, j, k);
 
   uint8x16_t mask = vdupq_n_u8(0x0f);
   uint8x16_t urow_hi = vld1q_u8(OCT_MUL_HI[u]);
   uint8x16_t urow_lo = vld1q_u8(OCT_MUL_LO[u]);
-  for (size_t idx = 0; idx < ALIGNED_COLS(k); idx += OCTMAT_ALIGN) {
+  for (size_t idx = 0; idx < ALIGNED_COLS(k); idx += sizeof(uint8x16_t)) {
     uint8x16_t bx = vld1q_u8(bp + idx);
     uint8x16_t lo = vandq_u8(bx, mask);
     bx = vshrq_n_u8(bx, 4);
@@ -82,20 +96,7 @@ void oaxpy(uint8_t *restrict a, uint8_t *restrict b, size_t i, size_t j,
   }
 }
 
-void oaddrow(uint8_t *restrict a, uint8_t *restrict b, size_t i, size_t j,
-             size_t k) {
-  octet *ap = a + (i * ALIGNED_COLS(k));
-  octet *bp = b + (j * ALIGNED_COLS(k));
-
-  for (size_t idx = 0; idx < ALIGNED_COLS(k); idx += OCTMAT_ALIGN) {
-    uint8x16_t ap128 = vld1q_u8(ap + idx);
-    uint8x16_t bp128 = vld1q_u8(bp + idx);
-
-    vst1q_u8(ap + idx, veorq_u8(ap128, bp128));
-  }
-}
-
-void oscal(uint8_t *restrict a, size_t i, size_t k, uint8_t u) {
+static void oscal_neon(uint8_t *restrict a, size_t i, size_t k, uint8_t u) {
   octet *ap = a + (i * ALIGNED_COLS(k));
 
   if (u < 2)
@@ -104,7 +105,7 @@ void oscal(uint8_t *restrict a, size_t i, size_t k, uint8_t u) {
   uint8x16_t mask = vdupq_n_u8(0x0f);
   uint8x16_t urow_hi = vld1q_u8(OCT_MUL_HI[u]);
   uint8x16_t urow_lo = vld1q_u8(OCT_MUL_LO[u]);
-  for (size_t idx = 0; idx < ALIGNED_COLS(k); idx += OCTMAT_ALIGN) {
+  for (size_t idx = 0; idx < ALIGNED_COLS(k); idx += sizeof(uint8x16_t)) {
     uint8x16_t ax = vld1q_u8(ap + idx);
     uint8x16_t lo = vandq_u8(ax, mask);
     ax = vshrq_n_u8(ax, 4);
@@ -115,30 +116,65 @@ void oscal(uint8_t *restrict a, size_t i, size_t k, uint8_t u) {
   }
 }
 
-void ozero(uint8_t *restrict a, size_t i, size_t k) {
+static void ozero_neon(uint8_t *restrict a, size_t i, size_t k) {
   octet *ap = a + (i * ALIGNED_COLS(k));
 
   uint8x16_t z128 = vdupq_n_u8(0);
-  for (size_t idx = 0; idx < ALIGNED_COLS(k); idx += OCTMAT_ALIGN) {
+  for (size_t idx = 0; idx < ALIGNED_COLS(k); idx += sizeof(uint8x16_t)) {
     vst1q_u8(ap + idx, z128);
   }
 }
 
-void ogemm(uint8_t *restrict a, uint8_t *restrict b, uint8_t *restrict c,
-           size_t n, size_t k, size_t m) {
-  octet *ap, *cp = c;
+#define NEON_MUL(x, lo, hi, mask)                                            \
+  veorq_u8(vqtbl1q_u8(lo, vandq_u8(x, mask)),                                  \
+           vqtbl1q_u8(hi, vandq_u8(vshrq_n_u8(x, 4), mask)))
 
-  for (size_t row = 0; row < n; row++, cp += ALIGNED_COLS(m)) {
-    ap = a + (row * ALIGNED_COLS(k));
+// four sources per pass, their tables stay in registers across the row
+static void oaxpy_multi4(uint8_t *restrict a, uint8_t **b, const uint8_t *u,
+                         size_t k) {
+  uint8x16_t mask = vdupq_n_u8(0x0f);
+  uint8x16_t lo0 = vld1q_u8(OCT_MUL_LO[u[0]]);
+  uint8x16_t hi0 = vld1q_u8(OCT_MUL_HI[u[0]]);
+  uint8x16_t lo1 = vld1q_u8(OCT_MUL_LO[u[1]]);
+  uint8x16_t hi1 = vld1q_u8(OCT_MUL_HI[u[1]]);
+  uint8x16_t lo2 = vld1q_u8(OCT_MUL_LO[u[2]]);
+  uint8x16_t hi2 = vld1q_u8(OCT_MUL_HI[u[2]]);
+  uint8x16_t lo3 = vld1q_u8(OCT_MUL_LO[u[3]]);
+  uint8x16_t hi3 = vld1q_u8(OCT_MUL_HI[u[3]]);
+
+  for (size_t idx = 0; idx < ALIGNED_COLS(k); idx += sizeof(uint8x16_t)) {
+    uint8x16_t acc = veorq_u8(NEON_MUL(vld1q_u8(b[0] + idx), lo0, hi0, mask),
+                              NEON_MUL(vld1q_u8(b[1] + idx), lo1, hi1, mask));
+    acc = veorq_u8(acc, NEON_MUL(vld1q_u8(b[2] + idx), lo2, hi2, mask));
+    acc = veorq_u8(acc, NEON_MUL(vld1q_u8(b[3] + idx), lo3, hi3, mask));
+    vst1q_u8(a + idx, veorq_u8(vld1q_u8(a + idx), acc));
+  }
+}
 
-    ozero(cp, 0, m);
-    for (size_t idx = 0; idx < k; idx++) {
-      oaxpy(cp, b, 0, idx, m, ap[idx]);
-    }
+static void oaddrow4(uint8_t *restrict a, uint8_t **b, size_t k) {
+  for (size_t idx = 0; idx < ALIGNED_COLS(k); idx += sizeof(uint8x16_t)) {
+    uint8x16_t acc = veorq_u8(vld1q_u8(b[0] + idx), vld1q_u8(b[1] + idx));
+    acc = veorq_u8(acc, vld1q_u8(b[2] + idx));
+    acc = veorq_u8(acc, vld1q_u8(b[3] + idx));
+    vst1q_u8(a + idx, veorq_u8(vld1q_u8(a + idx), acc));
+  }
+}
+
+static void oaxpy_multi_neon(uint8_t *restrict a, uint8_t **b, const uint8_t *u,
+                             size_t n, size_t k) {
+  size_t s = 0;
+  for (; s + 4 <= n; s += 4) {
+    if ((u[s] & u[s + 1] & u[s + 2] & u[s + 3]) == 1 &&
+        (u[s] | u[s + 1] | u[s + 2] | u[s + 3]) == 1)
+      oaddrow4(a, b + s, k);
+    else
+      oaxpy_multi4(a, b + s, u + s, k);
   }
+  for (; s < n; s++)
+    oaxpy_neon(a, b[s], 0, 0, k, u[s]);
 }
 
-size_t onnz(uint8_t *a, size_t i, size_t s, size_t e, size_t k) {
+static size_t onnz_neon(uint8_t *a, size_t i, size_t s, size_t e, size_t k) {
   octet *ap = a + (i * ALIGNED_COLS(k));
   size_t nz = 0;
   for (size_t idx = s; idx < e; idx++) {
@@ -147,7 +183,8 @@ size_t onnz(uint8_t *a, size_t i, size_t s, size_t e, size_t k) {
   return nz;
 }
 
-void oaxpy_b32(uint8_t *a, uint32_t *b, size_t i, size_t k, uint8_t u) {
+static void oaxpy_b32_neon(uint8_t *a, uint32_t *b, size_t i, size_t k,
+                           uint8_t u) {
   octet *ap = a + (i * ALIGNED_COLS(k));
   for (size_t idx = 0, p = 0; idx < k; idx += 8 * sizeof(uint32_t), p++) {
     uint32_t tmp = b[p];
@@ -158,3 +195,33 @@ void oaxpy_b32(uint8_t *a, uint32_t *b, size_t i, size_t k, uint8_t u) {
     }
   }
 }
+
+static void oaxpy_b8_neon(uint8_t *restrict a, uint8_t *restrict b, size_t i,
+                          size_t k, const uint8_t *u) {
+  octet *ap = a + (i * ALIGNED_COLS(k)), lo8[16], hi8[16];
+
+  OBLAS_B8_TABLES(lo8, hi8, u);
+  uint8x16_t mask = vdupq_n_u8(0x0f);
+  uint8x16_t lo = vld1q_u8(lo8);
+  uint8x16_t hi = vld1q_u8(hi8);
+  for (size_t idx = 0; idx < ALIGNED_COLS(k); idx += sizeof(uint8x16_t)) {
+    uint8x16_t bx = NEON_MUL(vld1q_u8(b + idx), lo, hi, mask);
+    vst1q_u8(ap + idx, veorq_u8(vld1q_u8(ap + idx), bx));
+  }
+}
+
+const oblas_kernels oblas_neon = {
+    .name = "neon",
+    .cpu = OBLAS_CPU_NEON,
+    .ocopy = ocopy_neon,
+    .oswaprow = oswaprow_neon,
+    .oswapcol = oswapcol_neon,
+    .oaxpy = oaxpy_neon,
+    .oaddrow = oaddrow_neon,
+    .oscal = oscal_neon,
+    .ozero = ozero_neon,
+    .onnz = onnz_neon,
+    .oaxpy_b32 = oaxpy_b32_neon,
+    .oaxpy_multi = oaxpy_multi_neon,
+    .oaxpy_b8 = oaxpy_b8_neon,
+};
@@ -1,21 +1,21 @@
 #include <emmintrin.h> /* sse2 */
 #include <tmmintrin.h> /* sse3 */
 
-#include "oblas.h"
+#include "oblas_kernels.h"
 
-void ocopy(uint8_t *restrict a, uint8_t *restrict b, size_t i, size_t j,
-           size_t k) {
+static void ocopy_sse(uint8_t *restrict a, uint8_t *restrict b, size_t i,
+                      size_t j, size_t k) {
   octet *ap = a + (i * ALIGNED_COLS(k));
   octet *bp = b + (j * ALIGNED_COLS(k));
 
   __m128i *ap128 = (__m128i *)ap;
   __m128i *bp128 = (__m128i *)bp;
-  for (size_t idx = 0; idx < ALIGNED_COLS(k); idx += OCTMAT_ALIGN) {
+  for (size_t idx = 0; idx < ALIGNED_COLS(k); idx += sizeof(__m128i)) {
     _mm_storeu_si128(ap128++, _mm_loadu_si128(bp128++));
   }
 }
 
-void oswaprow(uint8_t *restrict a, size_t i, size_t j, size_t k) {
+static void oswaprow_sse(uint8_t *restrict a, size_t i, size_t j, size_t k) {
   if (i == j)
     return;
   octet *ap = a + (i * ALIGNED_COLS(k));
@@ -23,7 +23,7 @@ void oswaprow(uint8_t *restrict a, size_t i, size_t j, size_t k) {
 
   __m128i *ap128 = (__m128i *)ap;
   __m128i *bp128 = (__m128i *)bp;
-  for (size_t idx = 0; idx < ALIGNED_COLS(k); idx += OCTMAT_ALIGN) {
+  for (size_t idx = 0; idx < ALIGNED_COLS(k); idx += sizeof(__m128i)) {
     __m128i atmp = _mm_loadu_si128((__m128i *)(ap128));
     __m128i btmp = _mm_loadu_si128((__m128i *)(bp128));
     _mm_storeu_si128(ap128++, btmp);
@@ -31,7 +31,8 @@ void oswaprow(uint8_t *restrict a, size_t i, size_t j, size_t k) {
   }
 }
 
-void oswapcol(octet *restrict a, size_t i, size_t j, size_t k, size_t l) {
+static void oswapcol_sse(octet *restrict a, size_t i, size_t j, size_t k,
+                         size_t l) {
   if (i == j)
     return;
   octet *ap = a;
@@ -41,8 +42,23 @@ void oswapcol(octet *restrict a, size_t i, size_t j, size_t k, size_t l) {
   }
 }
 
-void oaxpy(uint8_t *restrict a, uint8_t *restrict b, size_t i, size_t j,
-           size_t k, uint8_t u) {
+static void oaddrow_sse(uint8_t *restrict a, uint8_t *restrict b, size_t i,
+                        size_t j, size_t k) {
+  octet *ap = a + (i * ALIGNED_COLS(k));
+  octet *bp = b + (j * ALIGNED_COLS(k));
+
+  __m128i *ap128 = (__m128i *)ap;
+  __m128i *bp128 = (__m128i *)bp;
+  for (size_t idx = 0; idx < ALIGNED_COLS(k); idx += sizeof(__m128i)) {
+    _mm_storeu_si128(
+        ap128, _mm_xor_si128(_mm_loadu_si128(ap128), _mm_loadu_si128(bp128)));
+    ap128++;
+    bp128++;
+  }
+}
+
+static void oaxpy_sse(uint8_t *restrict a, uint8_t *restrict b, size_t i,
+                      size_t j, size_t k, uint8_t u) {
   octet *ap = a + (i * ALIGNED_COLS(k));
   octet *bp = b + (j * ALIGNED_COLS(k));
 
@@ -50,7 +66,7 @@ void oaxpy(uint8_t *restrict a, uint8_t *restrict b, size_t i, size_t j,
     return;
 
   if (u == 1)
-    return oaddrow(a, b, i, j, k);
+    return oaddrow_sse(a, b, i, j, k);
 
   const __m128i mask = _mm_set1_epi8(0x0f);
   const __m128i urow_hi = _mm_loadu_si128((__m128i *)OCT_MUL_HI[u]);
@@ -58,7 +74,7 @@ void oaxpy(uint8_t *restrict a, uint8_t *restrict b, size_t i, size_t j,
 
   __m128i *ap128 = (__m128i *)ap;
   __m128i *bp128 = (__m128i *)bp;
-  for (size_t idx = 0; idx < ALIGNED_COLS(k); idx += OCTMAT_ALIGN) {
+  for (size_t idx = 0; idx < ALIGNED_COLS(k); idx += sizeof(__m128i)) {
     __m128i bx = _mm_loadu_si128(bp128++);
     __m128i lo = _mm_and_si128(bx, mask);
     bx = _mm_srli_epi64(bx, 4);
@@ -72,22 +88,7 @@ void oaxpy(uint8_t *restrict a, uint8_t *restrict b, size_t i, size_t j,
   }
 }
 
-void oaddrow(uint8_t *restrict a, uint8_t *restrict b, size_t i, size_t j,
-             size_t k) {
-  octet *ap = a + (i * ALIGNED_COLS(k));
-  octet *bp = b + (j * ALIGNED_COLS(k));
-
-  __m128i *ap128 = (__m128i *)ap;
-  __m128i *bp128 = (__m128i *)bp;
-  for (size_t idx = 0; idx < ALIGNED_COLS(k); idx += OCTMAT_ALIGN) {
-    _mm_storeu_si128(
-        ap128, _mm_xor_si128(_mm_loadu_si128(ap128), _mm_loadu_si128(bp128)));
-    ap128++;
-    bp128++;
-  }
-}
-
-void oscal(uint8_t *restrict a, size_t i, size_t k, uint8_t u) {
+static void oscal_sse(uint8_t *restrict a, size_t i, size_t k, uint8_t u) {
   octet *ap = a + (i * ALIGNED_COLS(k));
 
   if (u < 2)
@@ -98,7 +99,7 @@ void oscal(uint8_t *restrict a, size_t i, size_t k, uint8_t u) {
   const __m128i urow_lo = _mm_loadu_si128((__m128i *)OCT_MUL_LO[u]);
 
   __m128i *ap128 = (__m128i *)ap;
-  for (size_t idx = 0; idx < ALIGNED_COLS(k); idx += OCTMAT_ALIGN) {
+  for (size_t idx = 0; idx < ALIGNED_COLS(k); idx += sizeof(__m128i)) {
     __m128i ax = _mm_loadu_si128(ap128);
     __m128i lo = _mm_and_si128(ax, mask);
     ax = _mm_srli_epi64(ax, 4);
@@ -110,31 +111,74 @@ void oscal(uint8_t *restrict a, size_t i, size_t k, uint8_t u) {
   }
 }
 
-void ozero(uint8_t *restrict a, size_t i, size_t k) {
+static void ozero_sse(uint8_t *restrict a, size_t i, size_t k) {
   octet *ap = a + (i * ALIGNED_COLS(k));
   __m128i *ap128 = (__m128i *)ap;
   __m128i z128 = _mm_setzero_si128();
 
-  for (size_t idx = 0; idx < ALIGNED_COLS(k); idx += OCTMAT_ALIGN) {
+  for (size_t idx = 0; idx < ALIGNED_COLS(k); idx += sizeof(__m128i)) {
     _mm_storeu_si128(ap128++, z128);
   }
 }
 
-void ogemm(uint8_t *restrict a, uint8_t *restrict b, uint8_t *restrict c,
-           size_t n, size_t k, size_t m) {
-  octet *ap, *cp = c;
+#define SSE_MUL(x, lo, hi, mask)                                             \
+  _mm_xor_si128(                                                               \
+      _mm_shuffle_epi8(lo, _mm_and_si128(x, mask)),                            \
+      _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi64(x, 4), mask)))
+
+// four sources per pass, their tables stay in registers across the row
+static void oaxpy_multi4(uint8_t *restrict a, uint8_t **b, const uint8_t *u,
+                         size_t k) {
+  const __m128i mask = _mm_set1_epi8(0x0f);
+  const __m128i lo0 = _mm_loadu_si128((__m128i *)OCT_MUL_LO[u[0]]);
+  const __m128i hi0 = _mm_loadu_si128((__m128i *)OCT_MUL_HI[u[0]]);
+  const __m128i lo1 = _mm_loadu_si128((__m128i *)OCT_MUL_LO[u[1]]);
+  const __m128i hi1 = _mm_loadu_si128((__m128i *)OCT_MUL_HI[u[1]]);
+  const __m128i lo2 = _mm_loadu_si128((__m128i *)OCT_MUL_LO[u[2]]);
+  const __m128i hi2 = _mm_loadu_si128((__m128i *)OCT_MUL_HI[u[2]]);
+  const __m128i lo3 = _mm_loadu_si128((__m128i *)OCT_MUL_LO[u[3]]);
+  const __m128i hi3 = _mm_loadu_si128((__m128i *)OCT_MUL_HI[u[3]]);
+
+  for (size_t idx = 0; idx < ALIGNED_COLS(k); idx += sizeof(__m128i)) {
+    __m128i *ap128 = (__m128i *)(a + idx);
+    __m128i x0 = _mm_loadu_si128((__m128i *)(b[0] + idx));
+    __m128i x1 = _mm_loadu_si128((__m128i *)(b[1] + idx));
+    __m128i x2 = _mm_loadu_si128((__m128i *)(b[2] + idx));
+    __m128i x3 = _mm_loadu_si128((__m128i *)(b[3] + idx));
+    __m128i acc = _mm_xor_si128(SSE_MUL(x0, lo0, hi0, mask),
+                                SSE_MUL(x1, lo1, hi1, mask));
+    acc = _mm_xor_si128(acc, SSE_MUL(x2, lo2, hi2, mask));
+    acc = _mm_xor_si128(acc, SSE_MUL(x3, lo3, hi3, mask));
+    _mm_storeu_si128(ap128, _mm_xor_si128(_mm_loadu_si128(ap128), acc));
+  }
+}
 
-  for (size_t row = 0; row < n; row++, cp += ALIGNED_COLS(m)) {
-    ap = a + (row * ALIGNED_COLS(k));
+static void oaddrow4(uint8_t *restrict a, uint8_t **b, size_t k) {
+  for (size_t idx = 0; idx < ALIGNED_COLS(k); idx += sizeof(__m128i)) {
+    __m128i *ap128 = (__m128i *)(a + idx);
+    __m128i acc = _mm_xor_si128(_mm_loadu_si128((__m128i *)(b[0] + idx)),
+                                _mm_loadu_si128((__m128i *)(b[1] + idx)));
+    acc = _mm_xor_si128(acc, _mm_loadu_si128((__m128i *)(b[2] + idx)));
+    acc = _mm_xor_si128(acc, _mm_loadu_si128((__m128i *)(b[3] + idx)));
+    _mm_storeu_si128(ap128, _mm_xor_si128(_mm_loadu_si128(ap128), acc));
+  }
+}
 
-    ozero(cp, 0, m);
-    for (size_t idx = 0; idx < k; idx++) {
-      oaxpy(cp, b, 0, idx, m, ap[idx]);
-    }
+static void oaxpy_multi_sse(uint8_t *restrict a, uint8_t **b, const uint8_t *u,
+                            size_t n, size_t k) {
+  size_t s = 0;
+  for (; s + 4 <= n; s += 4) {
+    if ((u[s] & u[s + 1] & u[s + 2] & u[s + 3]) == 1 &&
+        (u[s] | u[s + 1] | u[s + 2] | u[s + 3]) == 1)
+      oaddrow4(a, b + s, k);
+    else
+      oaxpy_multi4(a, b + s, u + s, k);
   }
+  for (; s < n; s++)
+    oaxpy_sse(a, b[s], 0, 0, k, u[s]);
 }
 
-size_t onnz(uint8_t *a, size_t i, size_t s, size_t e, size_t k) {
+static size_t onnz_sse(uint8_t *a, size_t i, size_t s, size_t e, size_t k) {
   octet *ap = a + (i * ALIGNED_COLS(k));
   size_t nz = 0;
   for (size_t idx = s; idx < e; idx++) {
@@ -143,7 +187,8 @@ size_t onnz(uint8_t *a, size_t i, size_t s, size_t e, size_t k) {
   return nz;
 }
 
-void oaxpy_b32(uint8_t *a, uint32_t *b, size_t i, size_t k, uint8_t u) {
+static void oaxpy_b32_sse(uint8_t *a, uint32_t *b, size_t i, size_t k,
+                          uint8_t u) {
   __m128i *ap128 = (__m128i *)(a + i * ALIGNED_COLS(k));
   __m128i scatter_hi =
       _mm_set_epi32(0x03030303, 0x03030303, 0x02020202, 0x02020202);
@@ -170,3 +215,34 @@ void oaxpy_b32(uint8_t *a, uint32_t *b, size_t i, size_t k, uint8_t u) {
     _mm_storeu_si128(ap128, _mm_xor_si128(_mm_loadu_si128(ap128), bytes_hi));
   }
 }
+
+static void oaxpy_b8_sse(uint8_t *restrict a, uint8_t *restrict b, size_t i,
+                         size_t k, const uint8_t *u) {
+  octet *ap = a + (i * ALIGNED_COLS(k)), lo8[16], hi8[16];
+
+  OBLAS_B8_TABLES(lo8, hi8, u);
+  const __m128i mask = _mm_set1_epi8(0x0f);
+  const __m128i lo = _mm_loadu_si128((__m128i *)lo8);
+  const __m128i hi = _mm_loadu_si128((__m128i *)hi8);
+  for (size_t idx = 0; idx < ALIGNED_COLS(k); idx += sizeof(__m128i)) {
+    __m128i *ap128 = (__m128i *)(ap + idx);
+    __m128i bx = SSE_MUL(_mm_loadu_si128((__m128i *)(b + idx)), lo, hi, mask);
+    _mm_storeu_si128(ap128, _mm_xor_si128(_mm_loadu_si128(ap128), bx));
+  }
+}
+
+const oblas_kernels oblas_sse = {
+    .name = "ssse3",
+    .cpu = OBLAS_CPU_SSSE3,
+    .ocopy = ocopy_sse,
+    .oswaprow = oswaprow_sse,
+    .oswapcol = oswapcol_sse,
+    .oaxpy = oaxpy_sse,
+    .oaddrow = oaddrow_sse,
+    .oscal = oscal_sse,
+    .ozero = ozero_sse,
+    .onnz = onnz_sse,
+    .oaxpy_b32 = oaxpy_b32_sse,
+    .oaxpy_multi = oaxpy_multi_sse,
+    .oaxpy_b8 = oaxpy_b8_sse,
+};
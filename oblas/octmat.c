@@ -13,6 +13,18 @@ void om_resize(octmat *v, size_t rows, size_t cols) {
   v->data = aligned;
 }
 
+void om_grow(octmat *v, size_t rows) {
+  if (rows <= v->rows)
+    return;
+  uint8_t *grown = (uint8_t *)oblas_alloc(rows, v->cols_al, OCTMAT_ALIGN);
+  if (v->data)
+    memcpy(grown, v->data, v->rows * v->cols_al);
+  memset(grown + v->rows * v->cols_al, 0, (rows - v->rows) * v->cols_al);
+  oblas_free(v->data);
+  v->data = grown;
+  v->rows = rows;
+}
+
 void om_copy(octmat *v1, octmat *v0) {
   v1->rows = v0->rows;
   v1->cols = v0->cols;
@@ -24,6 +36,24 @@ void om_copy(octmat *v1, octmat *v0) {
   memcpy(v1->data, v0->data, v0->rows * v0->cols_al);
 }
 
+void om_permute(octmat *v, int *from, uint8_t *tmp) {
+  // each cycle moves every row once, through one spare row
+  for (int i = 0; i < v->rows; i++) {
+    if (from[i] < 0 || from[i] == i)
+      continue;
+    memcpy(tmp, om_R(*v, i), v->cols_al);
+    int at = i;
+    while (from[at] != i) {
+      int next = from[at];
+      memcpy(om_R(*v, at), om_R(*v, next), v->cols_al);
+      from[at] = -1;
+      at = next;
+    }
+    memcpy(om_R(*v, at), tmp, v->cols_al);
+    from[at] = -1;
+  }
+}
+
 void om_destroy(octmat *v) {
   v->rows = 0;
   v->cols = 0;
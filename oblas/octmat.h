@@ -6,9 +6,14 @@
 #include <stdlib.h>
 #include <string.h>
 
+// row strides are a multiple of the widest vector any built backend uses
 #ifndef OCTMAT_ALIGN
+#if defined(__x86_64__) || defined(__i386__)
+#define OCTMAT_ALIGN 32
+#else
 #define OCTMAT_ALIGN 16
 #endif
+#endif
 
 typedef struct {
   uint8_t *data;
@@ -25,7 +30,11 @@ typedef struct {
 #define om_A(v, x, y) (om_R(v, x)[(y)])
 
 void om_resize(octmat *v, size_t rows, size_t cols);
+void om_grow(octmat *v, size_t rows);
 void om_copy(octmat *v1, octmat *v0);
+// row i of v becomes its row from[i] by way of tmp, a spare row of cols_al
+// bytes, from is clobbered
+void om_permute(octmat *v, int *from, uint8_t *tmp);
 void om_destroy(octmat *v);
 void om_print(octmat m, FILE *stream);
 
@@ -125,6 +125,25 @@ void print_shuf_hi_tab(FILE *stream, const gf field, gftbl *tabs) {
   fprintf(stream, "};\n\n");
 }
 
+/* multiplication by i as the GF(2) bit matrix GF2P8AFFINEQB takes, row r of
+ * the product in byte 7 - r */
+void print_affine_tab(FILE *stream, const gf field, gftbl *tabs) {
+  fprintf(stream, "{\n");
+  for (int i = 0; i < field.len; i++) {
+    uint64_t mat = 0;
+    for (int j = 0; j < field.exp && i > 0; j++) {
+      unsigned prod = tabs->EXP[(tabs->LOG[i] + j) % (field.len - 1)];
+      for (int r = 0; r < field.exp; r++)
+        if (prod & (1 << r))
+          mat |= (uint64_t)1 << (8 * (7 - r) + j);
+    }
+    fprintf(stream, "0x%016llxULL,", (unsigned long long)mat);
+    if (i % 4 == 3)
+      fprintf(stream, "\n");
+  }
+  fprintf(stream, "};\n\n");
+}
+
 void print_tabs(FILE *stream, const gf field, gftbl *tabs) {
   fprintf(stream, "#ifndef OCT_TABLES\n#define OCT_TABLES\n\n");
 
@@ -143,6 +162,9 @@ void print_tabs(FILE *stream, const gf field, gftbl *tabs) {
   fprintf(stream, "static const uint8_t OCT_MUL_HI[%d][16] = \n", field.len);
   print_shuf_hi_tab(stream, field, tabs);
 
+  fprintf(stream, "static const uint64_t OCT_MUL_AFFINE[%d] = \n", field.len);
+  print_affine_tab(stream, field, tabs);
+
   fprintf(stream, "#endif\n");
 }
 
@@ -0,0 +1,128 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "oblas.h"
+
+#define arena_round(n) (((n) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+static void *arena_chunk(size_t n) {
+  void *p = NULL;
+  if (posix_memalign(&p, ARENA_ALIGN, n) != 0)
+    return NULL;
+  return p;
+}
+
+arena *arena_new(size_t size) {
+  arena *a = calloc(1, sizeof(arena));
+  a->size = arena_round(size);
+  if (a->size)
+    a->base = arena_chunk(a->size);
+  kv_init(a->spill);
+  return a;
+}
+
+void arena_free(arena *a) {
+  if (!a)
+    return;
+  for (size_t it = 0; it < kv_size(a->spill); it++)
+    free(kv_A(a->spill, it));
+  kv_destroy(a->spill);
+  free(a->base);
+  free(a);
+}
+
+void arena_reset(arena *a) {
+  if (kv_size(a->spill) > 0) {
+    for (size_t it = 0; it < kv_size(a->spill); it++)
+      free(kv_A(a->spill, it));
+    kv_size(a->spill) = 0;
+    free(a->base);
+    // with some slack, the next block may need a little more
+    a->size = arena_round(a->need + a->need / 4);
+    a->base = arena_chunk(a->size);
+  }
+  a->used = 0;
+  a->need = 0;
+  a->last = NULL;
+}
+
+void *arena_alloc(arena *a, size_t n) {
+  if (!a)
+    return malloc(n ? n : 1);
+  n = arena_round(n ? n : 1);
+  a->need += n;
+  if (a->used + n <= a->size) {
+    a->last = a->base + a->used;
+    a->used += n;
+    return a->last;
+  }
+  void *p = arena_chunk(n);
+  kv_push(void *, a->spill, p);
+  return p;
+}
+
+void *arena_calloc(arena *a, size_t nmemb, size_t size) {
+  if (!a)
+    return calloc(nmemb ? nmemb : 1, size);
+  void *p = arena_alloc(a, nmemb * size);
+  memset(p, 0, nmemb * size);
+  return p;
+}
+
+void *arena_realloc(arena *a, void *p, size_t old, size_t n) {
+  if (!a)
+    return realloc(p, n);
+  if (p && p == a->last) {
+    size_t at = a->last - a->base;
+    if (at + arena_round(n) <= a->size) {
+      a->need += arena_round(n) - (a->used - at);
+      a->used = at + arena_round(n);
+      return p;
+    }
+  }
+  void *q = arena_alloc(a, n);
+  if (p)
+    memcpy(q, p, old < n ? old : n);
+  return q;
+}
+
+void arena_release(arena *a, void *p) {
+  if (!a)
+    free(p);
+}
+
+void arena_octmat(arena *a, octmat *m, size_t rows, size_t cols) {
+  if (!a) {
+    om_resize(m, rows, cols);
+    return;
+  }
+  m->rows = rows;
+  m->cols = cols;
+  m->cols_al = ALIGNED_COLS(cols);
+  m->data = arena_calloc(a, rows, m->cols_al);
+}
+
+void arena_octmat_release(arena *a, octmat *m) {
+  if (!a) {
+    om_destroy(m);
+    return;
+  }
+  *m = (octmat)OM_INITIAL;
+}
+
+gf2mat *arena_gf2mat(arena *a, size_t rows, size_t cols) {
+  if (!a)
+    return gf2mat_new(rows, cols);
+  gf2mat *g = arena_alloc(a, sizeof(gf2mat));
+  g->rows = rows;
+  g->cols = cols;
+  g->stride = div_ceil(cols, gf2wsz);
+  g->bits = arena_calloc(a, rows, g->stride * sizeof(gf2word));
+  return g;
+}
+
+void arena_gf2mat_release(arena *a, gf2mat *g) {
+  if (!a)
+    gf2mat_free(g);
+}
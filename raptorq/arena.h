@@ -0,0 +1,58 @@
+#ifndef NANORQ_ARENA_H
+#define NANORQ_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "gf2.h"
+#include "octmat.h"
+#include "util.h"
+
+// every block handed out is aligned to this, enough for any oblas backend
+#define ARENA_ALIGN 64
+
+/* bump allocator for the temporaries of one block inversion, reset rather
+ * than freed between blocks. blocks that do not fit get a chunk of their own
+ * and the next reset grows the arena to what the cycle needed, so repeated
+ * inversions of the same size allocate nothing. the functions below take a
+ * NULL arena to mean the heap, where release frees again */
+typedef struct {
+  uint8_t *base;
+  size_t size; /* bytes at base */
+  size_t used; /* bytes of base handed out since the last reset */
+  size_t need; /* bytes handed out since the last reset, spills included */
+  uint8_t *last; /* latest block from base, which can grow in place */
+  kvec_t(void *) spill;
+} arena;
+
+arena *arena_new(size_t size);
+void arena_free(arena *a);
+
+// drops every block handed out, growing base if any of them spilled
+void arena_reset(arena *a);
+
+void *arena_alloc(arena *a, size_t n);
+void *arena_calloc(arena *a, size_t nmemb, size_t size);
+// p holds old bytes, grown in place when it is the latest block
+void *arena_realloc(arena *a, void *p, size_t old, size_t n);
+void arena_release(arena *a, void *p);
+
+// kv_push for a kvec whose storage comes from arena mem
+#define arena_kv_push(mem, type, v, x)                                         \
+  do {                                                                         \
+    if ((v).n == (v).m) {                                                      \
+      size_t m_ = (v).m ? 2 * (v).m : 16;                                      \
+      (v).a = (type *)arena_realloc(mem, (v).a, (v).m * sizeof(type),          \
+                                    m_ * sizeof(type));                        \
+      (v).m = m_;                                                              \
+    }                                                                          \
+    (v).a[(v).n++] = (x);                                                      \
+  } while (0)
+
+// zeroed matrices carved from a, from oblas when a is NULL
+void arena_octmat(arena *a, octmat *m, size_t rows, size_t cols);
+void arena_octmat_release(arena *a, octmat *m);
+gf2mat *arena_gf2mat(arena *a, size_t rows, size_t cols);
+void arena_gf2mat_release(arena *a, gf2mat *g);
+
+#endif
@@ -0,0 +1,295 @@
+#include <pthread.h>
+#include <stdio.h>
+
+#include "cache.h"
+#include "precode.h"
+
+#define CACHE_MAGIC 0x5351524e /* "NRQS" */
+#define CACHE_VERSION 2
+// precode data kept for K' no nanorq uses any more
+#define CACHE_IDLE_BYTES (16 << 20)
+
+typedef struct {
+  uint16_t Kprime;
+  unsigned refs;  /* nanorq instances of this K' alive */
+  uint64_t stamp; /* cache_clock when the last of them went */
+  schedule *S;
+  octmat *G; /* source symbol -> intermediate symbol map */
+  spmat *A;  /* precode matrix of isi 0..K'-1 */
+  octmat *HDPC;
+  bool busy;
+} cache_entry;
+
+static kvec_t(cache_entry) entries = {0, 0, NULL};
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cache_ready = PTHREAD_COND_INITIALIZER;
+static bool dirty = false;
+static size_t idle_limit = CACHE_IDLE_BYTES;
+static uint64_t cache_clock = 0;
+
+static cache_entry *cache_find(uint16_t Kprime) {
+  for (size_t it = 0; it < kv_size(entries); it++) {
+    if (kv_A(entries, it).Kprime == Kprime)
+      return &kv_A(entries, it);
+  }
+  return NULL;
+}
+
+// call with cache_lock held
+static cache_entry *cache_get(uint16_t Kprime) {
+  cache_entry *e = cache_find(Kprime);
+  if (e == NULL) {
+    cache_entry ne = {Kprime, 0, 0, NULL, NULL, NULL, NULL, false};
+    kv_push(cache_entry, entries, ne);
+    e = &kv_A(entries, kv_size(entries) - 1);
+  }
+  return e;
+}
+
+static size_t sched_bytes(schedule *S) {
+  if (S == NULL)
+    return 0;
+  return (3 * S->rows + 2 * S->cols) * sizeof(int) +
+         (S->prog.len + 1) * sizeof(uint32_t);
+}
+
+static size_t om_bytes(octmat *m) { return m ? m->rows * m->cols_al : 0; }
+
+// the matrices derived from the schedule or from K' alone
+static size_t entry_derived(cache_entry *e) {
+  size_t A = e->A ? (e->A->rows + 1 + e->A->ptr[e->A->rows]) : 0;
+  return om_bytes(e->G) + A * sizeof(unsigned) + om_bytes(e->HDPC);
+}
+
+static void entry_drop_derived(cache_entry *e) {
+  if (e->G)
+    om_destroy(e->G);
+  if (e->HDPC)
+    om_destroy(e->HDPC);
+  free(e->G);
+  free(e->HDPC);
+  spmat_free(e->A);
+  e->G = e->HDPC = NULL;
+  e->A = NULL;
+}
+
+// the least recently used entry nobody holds, NULL if there is none
+static cache_entry *cache_lru(size_t *idle, bool derived) {
+  cache_entry *lru = NULL;
+  *idle = 0;
+  for (size_t it = 0; it < kv_size(entries); it++) {
+    cache_entry *e = &kv_A(entries, it);
+    if (e->refs > 0 || e->busy)
+      continue;
+    size_t derived_bytes = entry_derived(e);
+    *idle += sched_bytes(e->S) + derived_bytes;
+    if (derived && derived_bytes == 0)
+      continue;
+    if (lru == NULL || e->stamp < lru->stamp)
+      lru = e;
+  }
+  return lru;
+}
+
+// drops what no nanorq holds until it fits idle_limit, the matrices rebuilt
+// from a schedule go first, then whole entries. call with cache_lock held
+static void cache_trim(void) {
+  size_t idle;
+  cache_entry *e;
+  while ((e = cache_lru(&idle, true)) && idle > idle_limit)
+    entry_drop_derived(e);
+  while ((e = cache_lru(&idle, false)) && idle > idle_limit) {
+    sched_free(e->S);
+    *e = kv_A(entries, kv_size(entries) - 1);
+    kv_size(entries)--;
+  }
+}
+
+void cache_acquire(params *P) {
+  pthread_mutex_lock(&cache_lock);
+  cache_get(P->Kprime)->refs++;
+  pthread_mutex_unlock(&cache_lock);
+}
+
+void cache_release(params *P) {
+  pthread_mutex_lock(&cache_lock);
+  cache_entry *e = cache_find(P->Kprime);
+  if (e && e->refs > 0) {
+    e->refs--;
+    e->stamp = ++cache_clock;
+  }
+  cache_trim();
+  pthread_mutex_unlock(&cache_lock);
+}
+
+void cache_limit(size_t bytes) {
+  pthread_mutex_lock(&cache_lock);
+  idle_limit = bytes;
+  cache_trim();
+  pthread_mutex_unlock(&cache_lock);
+}
+
+schedule *cache_schedule(params *P) {
+  pthread_mutex_lock(&cache_lock);
+  cache_entry *e = cache_get(P->Kprime);
+  // blocks of the same K' wait for the inversion already in flight
+  while (e->busy) {
+    pthread_cond_wait(&cache_ready, &cache_lock);
+    e = cache_find(P->Kprime);
+  }
+  if (e->S == NULL) {
+    e->busy = true;
+    pthread_mutex_unlock(&cache_lock);
+    spmat *A = precode_matrix_gen(P, NULL, 0, NULL);
+    schedule *S = precode_matrix_invert(P, A, PRECODE_FAST);
+    // replayed for every block of this K', so it is worth fusing
+    if (S)
+      sched_compile(S, true);
+    pthread_mutex_lock(&cache_lock);
+    e = cache_find(P->Kprime);
+    e->S = S;
+    e->busy = false;
+    dirty = (S != NULL) || dirty;
+    pthread_cond_broadcast(&cache_ready);
+  }
+  schedule *S = e->S;
+  pthread_mutex_unlock(&cache_lock);
+  return S;
+}
+
+octmat *cache_generator(params *P) {
+  schedule *S = cache_schedule(P);
+  if (S == NULL)
+    return NULL;
+
+  pthread_mutex_lock(&cache_lock);
+  cache_entry *e = cache_find(P->Kprime);
+  while (e->busy) {
+    pthread_cond_wait(&cache_ready, &cache_lock);
+    e = cache_find(P->Kprime);
+  }
+  if (e->G == NULL) {
+    e->busy = true;
+    pthread_mutex_unlock(&cache_lock);
+    // run the loss-free schedule over unit source symbols, row l of the
+    // result holds the coefficients of intermediate symbol l
+    octmat *G = calloc(1, sizeof(octmat));
+    om_resize(G, P->L, P->Kprime);
+    for (int i = 0; i < P->Kprime; i++)
+      om_A(*G, P->S + P->H + i, i) = 1;
+    precode_matrix_intermediate(P, G, S, NULL);
+    pthread_mutex_lock(&cache_lock);
+    e = cache_find(P->Kprime);
+    e->G = G;
+    e->busy = false;
+    pthread_cond_broadcast(&cache_ready);
+  }
+  octmat *G = e->G;
+  pthread_mutex_unlock(&cache_lock);
+  return G;
+}
+
+// the inversion cache_schedule runs while its entry is busy needs these two,
+// so they are built under the lock instead of waiting on busy. both take
+// well under a millisecond next to the inversion that reads them
+const spmat *cache_precode(params *P) {
+  pthread_mutex_lock(&cache_lock);
+  cache_entry *e = cache_get(P->Kprime);
+  if (e->A == NULL)
+    e->A = precode_matrix_base(P);
+  spmat *A = e->A;
+  pthread_mutex_unlock(&cache_lock);
+  return A;
+}
+
+const octmat *cache_HDPC(params *P) {
+  pthread_mutex_lock(&cache_lock);
+  cache_entry *e = cache_get(P->Kprime);
+  if (e->HDPC == NULL)
+    e->HDPC = precode_matrix_HDPC(P);
+  octmat *HDPC = e->HDPC;
+  pthread_mutex_unlock(&cache_lock);
+  return HDPC;
+}
+
+bool cache_load(const char *path) {
+  FILE *fp = fopen(path, "rb");
+  if (!fp)
+    return false;
+
+  uint32_t hdr[3];
+  bool ok = fread(hdr, sizeof(uint32_t), 3, fp) == 3 &&
+            hdr[0] == CACHE_MAGIC && hdr[1] == CACHE_VERSION;
+
+  pthread_mutex_lock(&cache_lock);
+  for (uint32_t it = 0; ok && it < hdr[2]; it++) {
+    uint16_t Kprime;
+    if (fread(&Kprime, sizeof(Kprime), 1, fp) != 1) {
+      ok = false;
+      break;
+    }
+    schedule *S = sched_read(fp);
+    params P = params_init(Kprime);
+    if (S == NULL || P.Kprime != Kprime || S->cols != P.L) {
+      sched_free(S);
+      ok = false;
+      break;
+    }
+    cache_entry *e = cache_find(Kprime);
+    if (e && e->S) {
+      sched_free(S);
+    } else if (e) {
+      e->S = S;
+    } else {
+      cache_entry ne = {Kprime, 0, 0, S, NULL, NULL, NULL, false};
+      kv_push(cache_entry, entries, ne);
+    }
+  }
+  if (ok)
+    dirty = false;
+  // nothing holds the loaded schedules yet, they stay within the limit
+  cache_trim();
+  pthread_mutex_unlock(&cache_lock);
+  fclose(fp);
+  return ok;
+}
+
+bool cache_save(const char *path) {
+  char tmp[4096];
+  if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= sizeof(tmp))
+    return false;
+  FILE *fp = fopen(tmp, "wb");
+  if (!fp)
+    return false;
+
+  pthread_mutex_lock(&cache_lock);
+  uint32_t hdr[3] = {CACHE_MAGIC, CACHE_VERSION, 0};
+  for (size_t it = 0; it < kv_size(entries); it++)
+    hdr[2] += (kv_A(entries, it).S != NULL);
+  bool ok = fwrite(hdr, sizeof(uint32_t), 3, fp) == 3;
+  for (size_t it = 0; ok && it < kv_size(entries); it++) {
+    cache_entry *e = &kv_A(entries, it);
+    if (e->S == NULL)
+      continue;
+    ok = fwrite(&e->Kprime, sizeof(e->Kprime), 1, fp) == 1 &&
+         sched_write(e->S, fp);
+  }
+  if (ok)
+    dirty = false;
+  pthread_mutex_unlock(&cache_lock);
+
+  ok = (fclose(fp) == 0) && ok;
+  // replace atomically so a crash never leaves a truncated cache behind
+  if (ok)
+    ok = rename(tmp, path) == 0;
+  if (!ok)
+    remove(tmp);
+  return ok;
+}
+
+bool cache_dirty(void) {
+  pthread_mutex_lock(&cache_lock);
+  bool ret = dirty;
+  pthread_mutex_unlock(&cache_lock);
+  return ret;
+}
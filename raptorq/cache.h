@@ -0,0 +1,39 @@
+#ifndef NANORQ_CACHE_H
+#define NANORQ_CACHE_H
+
+#include <stdbool.h>
+
+#include "params.h"
+#include "sched.h"
+#include "spmat.h"
+
+// every nanorq holds the entry of its K' while it lives, entries nobody
+// holds are dropped least recently used first once they exceed the limit
+void cache_acquire(params *P);
+void cache_release(params *P);
+
+// bytes kept for entries nobody holds
+void cache_limit(size_t bytes);
+
+// returns the process wide loss-free encoding schedule for P->Kprime
+schedule *cache_schedule(params *P);
+
+// returns the process wide L x K' map from source to intermediate symbols
+octmat *cache_generator(params *P);
+
+// returns the process wide precode matrix of isi 0..K'-1 for P->Kprime
+const spmat *cache_precode(params *P);
+
+// returns the process wide HDPC rows for P->Kprime
+const octmat *cache_HDPC(params *P);
+
+// merge schedules stored in path into the cache
+bool cache_load(const char *path);
+
+// write every cached schedule to path
+bool cache_save(const char *path);
+
+// returns whether schedules were added since the last load/save
+bool cache_dirty(void);
+
+#endif
@@ -246,7 +246,7 @@ static size_t mmapio_read(struct ioctx *io, uint8_t *buf, size_t len) {
     return diff;
   }
 
-  if (at + len < _io->mapsize) {
+  if (at + len <= _io->mapsize) {
     memcpy(buf, _io->ptr + at, len);
     _io->pos += len;
     return len;
@@ -358,8 +358,12 @@ struct ioctx *ioctx_mmap_file(const char *fn, int t) {
     struct stat sb;
     fstat(fd, &sb);
     filesize = sb.st_size;
-    if (filesize < mapsize)
-      mapsize = filesize;
+    if (filesize == 0) {
+      close(fd);
+      return NULL;
+    }
+    // map the whole input so serving a symbol never remaps
+    mapsize = filesize;
     ptr = mmapio_mmap(mapsize, false, fd, offset);
   } else {
     ftruncate(fd, mapsize);
@@ -1,16 +1,18 @@
 #include <stdio.h>
 
 #include "bitmask.h"
+#include "cache.h"
 #include "nanorq.h"
 #include "precode.h"
+#include "tpool.h"
 #include "tuple.h"
 
-#define APPLYROW(D, w, a, k)                                                   \
-  do {                                                                         \
-    uint8_t *tmp = om_R(*D, w);                                                \
-    for (int i = 0; i < k; i++)                                                \
-      a[i] ^= tmp[i];                                                          \
-  } while (0);
+// LT plus PI rows a tuple combines
+#define NANORQ_TUPLE_MAX_ROWS 33
+// repair tuples kept per transfer, 1.5 MiB once all are in use
+#define NANORQ_TUPLE_CACHE 65536
+// isi of an LT row of D no symbol arrived for yet
+#define NANORQ_ROW_FREE UINT32_MAX
 
 struct oti_common {
   size_t F;  /* input size in bytes */
@@ -37,13 +39,49 @@ struct source_block {
   struct partition part;
 };
 
+/* on arrival Gauss-Jordan elimination over the missing source symbols */
+struct inc_decoder {
+  octmat *G;     /* shared L x K' source -> intermediate map */
+  octmat coef;   /* reduced equations over the source columns */
+  octmat sym;    /* their right hand sides */
+  int *pivot;    /* pivot column of each stored row */
+  int *owner;    /* row pivoting each source column, -1 if none */
+  size_t rows;
+  size_t unknown; /* source columns neither received nor solved */
+};
+
+/* a nanorq_repair_async attempt, D belongs to the worker while it runs */
+struct repair_attempt {
+  nanorq *rq;
+  uint8_t sbn;
+  bool ok;     /* M holds the missing source symbols in esi order */
+  int gaps;    /* source symbols missing when the attempt was queued */
+  arena *mem;  /* the inversion temporaries and M */
+  octmat M;
+  tpool_batch *batch;
+  uint_vec held;     /* esi of the symbols of sbn that arrived meanwhile */
+  octmat held_sym;   /* and their data, added once the attempt is reaped */
+  bitmask held_mask; /* the esi in held */
+};
+
 struct block_encoder {
   uint16_t K;
   bool loaded;
   bool inverted;
+  bool pending; /* queued for background inversion, D is not ours */
   octmat D;
-  repair_vec repair_bin;
+  octmat sym; /* aligned scratch row for encoding symbols */
+  /* the batch decoder keeps every received symbol in a row of D, isi[r] is
+   * the isi held by LT row S + H + r */
+  uint32_t *isi;
+  size_t sources; /* source symbols received */
+  size_t repairs; /* repair symbols received */
+  size_t missing; /* source symbols neither received nor decoded yet */
+  size_t hole;    /* LT rows below S + H + hole are all taken */
+  size_t extra;   /* rows past L taken once no LT row was free */
   bitmask repair_mask;
+  struct inc_decoder *inc;
+  struct repair_attempt *attempt;
 };
 
 struct nanorq {
@@ -53,7 +91,19 @@ struct nanorq {
   struct partition sub_part; /* (TL, TS, NL, NS) = Partition[T/Al, N] */
   params P;
   uint32_t max_esi;
+  size_t mem_cur;  /* bytes of symbol storage held by the blocks */
+  size_t mem_peak;
+  size_t blocks_left; /* blocks still missing source symbols */
   schedule *S;
+  tpool *pool;
+  tpool_batch *batch; /* background inversion in flight */
+  arena *mem;         /* temporaries of nanorq_repair_block */
+  kvec_t(arena *) arenas;  /* idle arenas of nanorq_repair_async attempts */
+  kvec_t(uint8_t) inflight; /* sbn of the attempts in flight, oldest first */
+  tuple *tuples;      /* of the repair isi K' onwards, see repair_tuples */
+  size_t ntuples;
+  bool incremental;   /* decode on arrival instead of in nanorq_repair_block */
+  precode_strategy strategy; /* row selection of batch inversions */
   struct block_encoder *encoders[Z_max];
 };
 
@@ -127,19 +177,28 @@ static size_t get_symbol_offset(struct source_block *blk, size_t pos,
   return i;
 }
 
+static size_t om_bytes(octmat *m) { return m->rows * m->cols_al; }
+
+static void mem_account(nanorq *rq, size_t add, size_t sub) {
+  rq->mem_cur = rq->mem_cur + add - sub;
+  if (rq->mem_cur > rq->mem_peak)
+    rq->mem_peak = rq->mem_cur;
+}
+
 static struct block_encoder *get_block_encoder(nanorq *rq, uint8_t sbn) {
   if (rq->encoders[sbn])
     return rq->encoders[sbn];
 
   struct block_encoder *enc = calloc(1, sizeof(struct block_encoder));
   enc->K = nanorq_block_symbols(rq, sbn);
+  enc->missing = enc->K;
 
-  int spare = 0;
-  if (rq->max_esi) {
+  if (rq->max_esi)
     enc->repair_mask = bitmask_new(rq->max_esi);
-    spare = rq->max_esi - enc->K;
-  }
-  om_resize(&enc->D, rq->P.L + spare, rq->common.T);
+  // the encoder never needs more than L intermediate symbols, the decoder
+  // grows overhead rows in nanorq_repair_block once repair symbols arrived
+  om_resize(&enc->D, rq->P.L, rq->common.T);
+  mem_account(rq, om_bytes(&enc->D), 0);
 
   rq->encoders[sbn] = enc;
   return enc;
@@ -181,26 +240,69 @@ static bool load_symbol_matrix(nanorq *rq, uint8_t sbn, struct ioctx *io) {
   return true;
 }
 
-void decode_row(params *P, octmat *D, uint32_t row, uint8_t *ptr, size_t len) {
-  memset(ptr, 0, len);
-  tuple t = gen_tuple(row, P);
+// accumulate the encoding symbol of tuple t into row mrow of M, which must
+// share the column count (and so the aligned stride) of D for the oblas kernels
+static void decode_tuple(params *P, octmat *D, tuple t, octmat *M,
+                         size_t mrow) {
+  uint8_t *src[NANORQ_TUPLE_MAX_ROWS], ones[NANORQ_TUPLE_MAX_ROWS];
+  unsigned idx[NANORQ_TUPLE_MAX_ROWS], n = tuple_len(t) - 1;
+
+  tuple_idxs(t, P, idx);
+  ocopy(M->data, D->data, mrow, idx[0], D->cols);
+  for (unsigned j = 0; j < n; j++)
+    src[j] = om_R(*D, idx[j + 1]);
+
+  memset(ones, 1, n);
+  oaxpy_multi(om_R(*M, mrow), src, ones, n, D->cols);
+}
 
-  // ptr might be unaligned so xor directly instead of using oblas
-  APPLYROW(D, t.b, ptr, len);
-  for (unsigned j = 1; j < t.d; j++) {
-    t.b = (t.b + t.a) % P->W;
-    APPLYROW(D, t.b, ptr, len);
+static void decode_row(params *P, octmat *D, uint32_t isi, octmat *M,
+                       size_t mrow) {
+  decode_tuple(P, D, gen_tuple(isi, P), M, mrow);
+}
+
+// encode into the caller's buffer through the aligned per block scratch row
+static void encode_tuple(nanorq *rq, struct block_encoder *enc, tuple t,
+                         void *data) {
+  if (enc->sym.rows == 0) {
+    om_resize(&enc->sym, 1, enc->D.cols);
+    mem_account(rq, om_bytes(&enc->sym), 0);
   }
-  while (t.b1 >= P->P)
-    t.b1 = (t.b1 + t.a1) % P->P1;
+  decode_tuple(&rq->P, &enc->D, t, &enc->sym, 0);
+  memcpy(data, om_P(enc->sym), enc->D.cols);
+}
 
-  APPLYROW(D, P->W + t.b1, ptr, len);
-  for (unsigned j = 1; j < t.d1; j++) {
-    t.b1 = (t.b1 + t.a1) % P->P1;
-    while (t.b1 >= P->P)
-      t.b1 = (t.b1 + t.a1) % P->P1;
-    APPLYROW(D, P->W + t.b1, ptr, len);
+// the repair tuples depend on neither the block nor its data, so the carousels
+// of all blocks read them from one table that grows as the esi advance.
+// returns up to *n tuples from isi on, NULL when isi is not cached
+static const tuple *repair_tuples(nanorq *rq, uint32_t isi, size_t *n) {
+  size_t at = isi - rq->P.Kprime;
+  if (isi < rq->P.Kprime || at >= NANORQ_TUPLE_CACHE)
+    return NULL;
+  if (*n > NANORQ_TUPLE_CACHE - at)
+    *n = NANORQ_TUPLE_CACHE - at;
+  if (at + *n > rq->ntuples) {
+    size_t grow = rq->ntuples ? 2 * rq->ntuples : 1024;
+    if (grow < at + *n)
+      grow = at + *n;
+    if (grow > NANORQ_TUPLE_CACHE)
+      grow = NANORQ_TUPLE_CACHE;
+    tuple *ts = realloc(rq->tuples, grow * sizeof(tuple));
+    if (ts == NULL)
+      return NULL;
+    gen_tuples(&rq->P, NULL, rq->P.Kprime + rq->ntuples, grow - rq->ntuples,
+               ts + rq->ntuples);
+    rq->tuples = ts;
+    rq->ntuples = grow;
   }
+  return rq->tuples + at;
+}
+
+static void encode_row(nanorq *rq, struct block_encoder *enc, uint32_t isi,
+                       void *data) {
+  size_t one = 1;
+  const tuple *t = repair_tuples(rq, isi, &one);
+  encode_tuple(rq, enc, t ? *t : gen_tuple(isi, &rq->P), data);
 }
 
 bool nanorq_generate_symbols(nanorq *rq, uint8_t sbn, struct ioctx *io) {
@@ -215,22 +317,101 @@ bool nanorq_generate_symbols(nanorq *rq, uint8_t sbn, struct ioctx *io) {
   if (!enc->loaded)
     return false;
 
-  schedule *S = NULL;
-  if (rq->S) {
-    S = rq->S;
-  } else {
-    spmat *A = precode_matrix_gen(&rq->P, 0);
-    S = precode_matrix_invert(&rq->P, A);
-  }
+  // all blocks share one K', so the loss-free schedule is computed once
+  schedule *S = rq->S ? rq->S : cache_schedule(&rq->P);
   if (S == NULL)
     return false;
-  precode_matrix_intermediate(&rq->P, &enc->D, S);
-  if (rq->S == NULL)
-    sched_free(S);
+  precode_matrix_intermediate(&rq->P, &enc->D, S, rq->pool);
   enc->inverted = true;
   return true;
 }
 
+static bool block_pending(struct block_encoder *enc) {
+  return __atomic_load_n(&enc->pending, __ATOMIC_ACQUIRE);
+}
+
+static void generate_block(void *arg, unsigned sbn) {
+  nanorq *rq = (nanorq *)arg;
+  // source symbols are already loaded, so no io is needed here
+  nanorq_generate_symbols(rq, sbn, NULL);
+  // publish D and the inverted flag to the encoding thread
+  __atomic_store_n(&rq->encoders[sbn]->pending, false, __ATOMIC_RELEASE);
+}
+
+static tpool *get_pool(nanorq *rq, unsigned workers) {
+  if (tpool_threads(rq->pool) != workers) {
+    tpool_free(rq->pool);
+    rq->pool = tpool_new(workers);
+  }
+  return rq->pool;
+}
+
+static bool all_blocks_inverted(nanorq *rq) {
+  for (int sbn = 0; sbn < nanorq_blocks(rq); sbn++) {
+    if (!rq->encoders[sbn] || !rq->encoders[sbn]->inverted)
+      return false;
+  }
+  return true;
+}
+
+// ioctx is not thread safe, load every block before going parallel
+static bool load_all_blocks(nanorq *rq, struct ioctx *io) {
+  for (int sbn = 0; sbn < nanorq_blocks(rq); sbn++) {
+    struct block_encoder *enc = get_block_encoder(rq, sbn);
+    if (enc == NULL)
+      return false;
+    if (!enc->loaded)
+      enc->loaded = load_symbol_matrix(rq, sbn, io);
+    if (!enc->loaded)
+      return false;
+  }
+  return true;
+}
+
+bool nanorq_generate_all_symbols(nanorq *rq, struct ioctx *io,
+                                 unsigned nthreads) {
+  unsigned num_sbn = nanorq_blocks(rq);
+
+  if (!nanorq_generate_wait(rq) && !load_all_blocks(rq, io))
+    return false;
+
+  if (nthreads > num_sbn)
+    nthreads = num_sbn;
+  // the caller takes part in tpool_run, so one thread needs no worker
+  tpool_run(get_pool(rq, nthreads > 1 ? nthreads : 0), num_sbn,
+            generate_block, rq);
+  return all_blocks_inverted(rq);
+}
+
+bool nanorq_generate_async(nanorq *rq, struct ioctx *io, unsigned nthreads) {
+  unsigned num_sbn = nanorq_blocks(rq);
+
+  if (!nanorq_generate_wait(rq) && !load_all_blocks(rq, io))
+    return false;
+
+  if (nthreads > num_sbn)
+    nthreads = num_sbn;
+  for (unsigned sbn = 0; sbn < num_sbn; sbn++)
+    rq->encoders[sbn]->pending = !rq->encoders[sbn]->inverted;
+  // nobody waits on this batch right away, so it needs at least one worker
+  rq->batch = tpool_submit(get_pool(rq, nthreads > 1 ? nthreads : 1),
+                           num_sbn, generate_block, rq);
+  return true;
+}
+
+bool nanorq_block_ready(nanorq *rq, uint8_t sbn) {
+  struct block_encoder *enc = rq->encoders[sbn];
+  return enc && !block_pending(enc) && enc->inverted;
+}
+
+bool nanorq_generate_wait(nanorq *rq) {
+  if (rq->batch) {
+    tpool_wait(rq->batch);
+    rq->batch = NULL;
+  }
+  return all_blocks_inverted(rq);
+}
+
 /*
  * len: total transfer size in bytes
  * T: size of each symbol in bytes (should be aligned to Al)
@@ -287,6 +468,7 @@ nanorq *nanorq_encoder_new_ex(size_t len, uint16_t T, uint16_t K, uint16_t Z,
   rq->src_part = fill_partition(rq->scheme.Kt, rq->scheme.Z);
   rq->sub_part = fill_partition(rq->common.T / rq->common.Al, rq->scheme.N);
   rq->P = params_init(nanorq_block_symbols(rq, 0));
+  cache_acquire(&rq->P);
 
   return rq;
 }
@@ -298,10 +480,19 @@ nanorq *nanorq_encoder_new(size_t len, uint16_t T, uint8_t Al) {
 void nanorq_free(nanorq *rq) {
   int num_sbn = nanorq_blocks(rq);
   if (rq) {
-    if (rq->S)
-      sched_free(rq->S);
+    nanorq_generate_wait(rq);
+    // drops the repair attempts in flight before their pool goes
     for (int sbn = 0; sbn < num_sbn; sbn++)
       nanorq_encoder_cleanup(rq, sbn);
+    tpool_free(rq->pool);
+    arena_free(rq->mem);
+    for (size_t it = 0; it < kv_size(rq->arenas); it++)
+      arena_free(kv_A(rq->arenas, it));
+    kv_destroy(rq->arenas);
+    kv_destroy(rq->inflight);
+    free(rq->tuples);
+    // the cached data of this K' may go once no other nanorq uses it
+    cache_release(&rq->P);
     free(rq);
   }
 }
@@ -409,8 +600,11 @@ nanorq *nanorq_decoder_new(uint64_t common, uint32_t scheme) {
   rq->src_part = fill_partition(rq->scheme.Kt, rq->scheme.Z);
   rq->sub_part = fill_partition(rq->common.T / rq->common.Al, rq->scheme.N);
   rq->P = params_init(nanorq_block_symbols(rq, 0));
+  cache_acquire(&rq->P);
 
   rq->max_esi = 2 * rq->P.Kprime;
+  rq->incremental = (rq->P.Kprime <= NANORQ_INC_MAX_KPRIME);
+  rq->blocks_left = nanorq_blocks(rq);
   return rq;
 }
 
@@ -429,16 +623,34 @@ size_t nanorq_blocks(nanorq *rq) {
   return (size_t)(rq->src_part.JL + rq->src_part.JS);
 }
 
+size_t nanorq_peak_memory(nanorq *rq) { return rq->mem_peak; }
+
 bool nanorq_precalculate(nanorq *rq) {
-  params P = params_init(nanorq_block_symbols(rq, 0));
-  spmat *A = precode_matrix_gen(&P, 0);
-  schedule *S = precode_matrix_invert(&P, A);
+  rq->S = cache_schedule(&rq->P);
+  return rq->S != NULL;
+}
+
+bool nanorq_schedule_ops(nanorq *rq, size_t *raw, size_t *ops,
+                         size_t *passes) {
+  schedule *S = rq->S ? rq->S : cache_schedule(&rq->P);
   if (S == NULL)
     return false;
-  rq->S = S;
+  *raw = S->prog.raw;
+  *ops = sched_prog_ops(S);
+  *passes = S->prog.groups;
   return true;
 }
 
+bool nanorq_cache_load(const char *path) { return cache_load(path); }
+
+bool nanorq_cache_save(const char *path) {
+  if (!cache_dirty())
+    return true;
+  return cache_save(path);
+}
+
+void nanorq_cache_limit(size_t bytes) { cache_limit(bytes); }
+
 size_t nanorq_encode(nanorq *rq, void *data, uint32_t esi, uint8_t sbn,
                      struct ioctx *io) {
   size_t written = 0;
@@ -447,8 +659,16 @@ size_t nanorq_encode(nanorq *rq, void *data, uint32_t esi, uint8_t sbn,
     return 0;
 
   if (esi < enc->K) {
-    if (enc->inverted) {
-      decode_row(&rq->P, &enc->D, esi, data, enc->D.cols);
+    if (io) {
+      // systematic symbols are the source data, read them straight from io
+      // instead of recombining intermediate symbols once D got inverted
+      memset(data, 0, enc->D.cols);
+      transfer_esi(rq, sbn, esi, enc->K, data, enc->D.cols, io, 0);
+      written += enc->D.cols;
+    } else if (block_pending(enc)) {
+      return 0; // D belongs to the background inversion
+    } else if (enc->inverted) {
+      encode_row(rq, enc, esi, data);
       written += enc->D.cols;
     } else {
       if (!enc->loaded)
@@ -461,50 +681,77 @@ size_t nanorq_encode(nanorq *rq, void *data, uint32_t esi, uint8_t sbn,
   } else {
     if (esi > ((1 << 24) - 1))
       return 0;
-    // esi is for repair symbol
+    // esi is for repair symbol, not available until the block is inverted
+    if (block_pending(enc))
+      return 0;
     if (!enc->inverted)
       enc->inverted = nanorq_generate_symbols(rq, sbn, io);
     if (enc->inverted) {
       uint32_t isi = esi + (rq->P.Kprime - enc->K);
-      decode_row(&rq->P, &enc->D, isi, data, enc->D.cols);
+      encode_row(rq, enc, isi, data);
       written += enc->D.cols;
     }
   }
   return written;
 }
 
-void nanorq_encoder_cleanup(nanorq *rq, uint8_t sbn) {
-  if (!rq->encoders[sbn])
-    return;
-  struct block_encoder *enc = rq->encoders[sbn];
-  om_destroy(&enc->D);
-  if (kv_size(enc->repair_bin) > 0) {
-    for (int rs = 0; rs < kv_size(enc->repair_bin); rs++)
-      om_destroy(&(kv_A(enc->repair_bin, rs).row));
-    kv_destroy(enc->repair_bin);
+size_t nanorq_encode_batch(nanorq *rq, uint8_t sbn, uint32_t esi_start,
+                           size_t count, uint8_t *out, size_t stride,
+                           struct ioctx *io) {
+  struct block_encoder *enc = get_block_encoder(rq, sbn);
+  if (enc == NULL || esi_start > ((1 << 24) - 1))
+    return 0;
+  if (count > (1 << 24) - esi_start)
+    count = (1 << 24) - esi_start;
+
+  size_t done = 0;
+  uint32_t esi = esi_start;
+  for (; done < count && esi < enc->K; done++, esi++) {
+    if (nanorq_encode(rq, out + done * stride, esi, sbn, io) != enc->D.cols)
+      return done;
   }
-  if (kv_size(enc->repair_mask) > 0)
-    bitmask_free(&enc->repair_mask);
-  free(enc);
-  rq->encoders[sbn] = NULL;
+  if (done == count || block_pending(enc))
+    return done;
+
+  if (!enc->inverted)
+    enc->inverted = nanorq_generate_symbols(rq, sbn, io);
+  if (!enc->inverted)
+    return done;
+
+  // pull the first row of the next tuple in while the current symbol is
+  // accumulated, tuples past the cache are generated a batch at a time
+  uint32_t isi = esi + (rq->P.Kprime - enc->K);
+  tuple buf[TUPLE_BATCH];
+  while (done < count) {
+    size_t n = count - done;
+    const tuple *ts = repair_tuples(rq, isi, &n);
+    if (ts == NULL) {
+      n = (n < TUPLE_BATCH) ? n : TUPLE_BATCH;
+      gen_tuples(&rq->P, NULL, isi, n, buf);
+      ts = buf;
+    }
+    for (size_t k = 0; k < n; k++) {
+      if (k + 1 < n)
+        __builtin_prefetch(om_R(enc->D, ts[k + 1].b));
+      encode_tuple(rq, enc, ts[k], out + (done + k) * stride);
+    }
+    done += n;
+    isi += n;
+  }
+  return done;
 }
 
-void nanorq_encoder_reset(nanorq *rq, uint8_t sbn) {
-  if (!rq->encoders[sbn])
+static void inc_free(nanorq *rq, struct block_encoder *dec) {
+  struct inc_decoder *inc = dec->inc;
+  if (inc == NULL)
     return;
-  struct block_encoder *enc = rq->encoders[sbn];
-  enc->loaded = false;
-  enc->inverted = false;
-  if (om_P(enc->D))
-    memset(om_P(enc->D), 0, enc->D.rows * enc->D.cols_al);
-  if (kv_size(enc->repair_bin) > 0) {
-    for (int rs = 0; rs < kv_size(enc->repair_bin); rs++)
-      om_destroy(&(kv_A(enc->repair_bin, rs).row));
-    kv_destroy(enc->repair_bin);
-    kv_init(enc->repair_bin);
-  }
-  if (kv_size(enc->repair_mask) > 0)
-    bitmask_reset(&enc->repair_mask);
+  mem_account(rq, 0, om_bytes(&inc->coef) + om_bytes(&inc->sym));
+  om_destroy(&inc->coef);
+  om_destroy(&inc->sym);
+  free(inc->pivot);
+  free(inc->owner);
+  free(inc);
+  dec->inc = NULL;
 }
 
 bool nanorq_set_max_esi(nanorq *rq, uint32_t max_esi) {
@@ -514,6 +761,211 @@ bool nanorq_set_max_esi(nanorq *rq, uint32_t max_esi) {
   return true;
 }
 
+// marks esi as held, esi must not have been held before
+static void block_mark(nanorq *rq, struct block_encoder *dec, uint32_t esi) {
+  bitmask_set(&dec->repair_mask, esi);
+  if (esi < dec->K && --dec->missing == 0)
+    rq->blocks_left--;
+}
+
+static struct inc_decoder *inc_new(nanorq *rq, struct block_encoder *dec) {
+  octmat *G = cache_generator(&rq->P);
+  if (G == NULL)
+    return NULL;
+
+  struct inc_decoder *inc = calloc(1, sizeof(struct inc_decoder));
+  inc->G = G;
+  inc->owner = malloc(dec->K * sizeof(int));
+  for (int c = 0; c < dec->K; c++)
+    inc->owner[c] = -1;
+  inc->unknown = dec->missing;
+  return inc;
+}
+
+static size_t inc_push_row(nanorq *rq, struct inc_decoder *inc, size_t T) {
+  if (inc->rows == inc->coef.rows) {
+    size_t grow = inc->rows ? 2 * inc->rows : 16;
+    size_t before = om_bytes(&inc->coef) + om_bytes(&inc->sym);
+    if (inc->rows == 0) {
+      om_resize(&inc->coef, grow, inc->G->cols);
+      om_resize(&inc->sym, grow, T);
+    } else {
+      om_grow(&inc->coef, grow);
+      om_grow(&inc->sym, grow);
+    }
+    mem_account(rq, om_bytes(&inc->coef) + om_bytes(&inc->sym), before);
+    inc->pivot = realloc(inc->pivot, grow * sizeof(int));
+  }
+  inc->pivot[inc->rows] = -1;
+  return inc->rows++;
+}
+
+static void inc_drop_row(struct inc_decoder *inc, size_t r) {
+  size_t last = --inc->rows;
+  if (r == last)
+    return;
+  ocopy(inc->coef.data, inc->coef.data, r, last, inc->coef.cols);
+  ocopy(inc->sym.data, inc->sym.data, r, last, inc->sym.cols);
+  inc->pivot[r] = inc->pivot[last];
+  if (inc->pivot[r] >= 0)
+    inc->owner[inc->pivot[r]] = r;
+}
+
+// reduce row r against the pivot rows, then make it a pivot row itself or
+// drop it when it adds no rank
+static void inc_insert(struct inc_decoder *inc, size_t r, uint16_t K) {
+  size_t cols = inc->coef.cols, T = inc->sym.cols;
+  uint8_t *row = om_R(inc->coef, r);
+
+  // pivot rows are zero on every other pivot column, so one pass clears them
+  for (int c = 0; c < K; c++) {
+    uint8_t u = row[c];
+    int p = inc->owner[c];
+    if (u == 0 || p < 0)
+      continue;
+    oaxpy(inc->coef.data, inc->coef.data, r, p, cols, u);
+    oaxpy(inc->sym.data, inc->sym.data, r, p, T, u);
+  }
+  int col = 0;
+  while (col < K && row[col] == 0)
+    col++;
+  if (col == K) {
+    inc_drop_row(inc, r);
+    return;
+  }
+
+  uint8_t u = row[col];
+  if (u != 1) {
+    oscal(inc->coef.data, r, cols, OCTET_DIV(1, u));
+    oscal(inc->sym.data, r, T, OCTET_DIV(1, u));
+  }
+  for (size_t q = 0; q < inc->rows; q++) {
+    uint8_t v = om_A(inc->coef, q, col);
+    if (q == r || v == 0)
+      continue;
+    oaxpy(inc->coef.data, inc->coef.data, q, r, cols, v);
+    oaxpy(inc->sym.data, inc->sym.data, q, r, T, v);
+  }
+  inc->pivot[r] = col;
+  inc->owner[col] = r;
+}
+
+// once every unknown column has a pivot, the reduced rows are the symbols
+static void inc_try_solve(nanorq *rq, uint8_t sbn, struct block_encoder *dec,
+                          struct ioctx *io) {
+  struct inc_decoder *inc = dec->inc;
+  if (inc->rows < inc->unknown)
+    return;
+  for (size_t r = 0; r < inc->rows; r++) {
+    int c = inc->pivot[r];
+    uint8_t *src = om_R(inc->sym, r);
+    memcpy(om_R(dec->D, rq->P.S + rq->P.H + c), src, dec->D.cols);
+    transfer_esi(rq, sbn, c, dec->K, src, dec->D.cols, io, 1);
+    block_mark(rq, dec, c);
+  }
+  inc_free(rq, dec);
+}
+
+static void inc_add_source(struct block_encoder *dec, uint32_t esi,
+                           size_t row) {
+  struct inc_decoder *inc = dec->inc;
+  for (size_t q = 0; q < inc->rows; q++) {
+    uint8_t v = om_A(inc->coef, q, esi);
+    if (v == 0)
+      continue;
+    oaxpy(inc->sym.data, dec->D.data, q, row, dec->D.cols, v);
+    om_A(inc->coef, q, esi) = 0;
+  }
+  inc->unknown--;
+  int p = inc->owner[esi];
+  if (p >= 0) {
+    // its equation now constrains the remaining unknowns only
+    inc->owner[esi] = -1;
+    inc->pivot[p] = -1;
+    inc_insert(inc, p, dec->K);
+  }
+}
+
+static void inc_add_repair(nanorq *rq, struct block_encoder *dec, uint32_t esi,
+                           void *data) {
+  struct inc_decoder *inc = dec->inc;
+  params *P = &rq->P;
+  size_t r = inc_push_row(rq, inc, dec->D.cols);
+
+  decode_row(P, inc->G, esi + (P->Kprime - dec->K), &inc->coef, r);
+  memcpy(om_R(inc->sym, r), data, dec->D.cols);
+
+  // move the source symbols we already hold to the right hand side,
+  // padding symbols are zero
+  uint8_t *row = om_R(inc->coef, r);
+  for (int c = 0; c < P->Kprime; c++) {
+    if (row[c] == 0)
+      continue;
+    if (c < dec->K && bitmask_check(&dec->repair_mask, c))
+      oaxpy(inc->sym.data, dec->D.data, r, P->S + P->H + c, dec->D.cols,
+            row[c]);
+    if (c >= dec->K || bitmask_check(&dec->repair_mask, c))
+      row[c] = 0;
+  }
+  inc_insert(inc, r, dec->K);
+}
+
+/* LT row of D a received symbol of the given isi goes to. a source symbol
+ * keeps its own row unless a repair symbol took it, anything else takes the
+ * lowest free LT row, and rows past L once none is left, so D ends up
+ * holding the rows of the decoding matrix without another copy */
+static size_t place_symbol(nanorq *rq, struct block_encoder *dec, uint32_t isi,
+                           bool source) {
+  params *P = &rq->P;
+  size_t lt = P->S + P->H, r;
+  if (dec->isi == NULL) {
+    if (source)
+      return lt + isi;
+    dec->isi = malloc((dec->D.rows - lt) * sizeof(uint32_t));
+    for (r = 0; r < P->Kprime; r++) {
+      bool held = r >= dec->K || bitmask_check(&dec->repair_mask, r);
+      dec->isi[r] = held ? r : NANORQ_ROW_FREE;
+    }
+  }
+
+  if (source && dec->isi[isi] == NANORQ_ROW_FREE) {
+    r = isi;
+  } else {
+    while (dec->hole < dec->K && dec->isi[dec->hole] != NANORQ_ROW_FREE)
+      dec->hole++;
+    r = (dec->hole < dec->K) ? dec->hole : P->Kprime + dec->extra++;
+  }
+  if (lt + r >= dec->D.rows) {
+    // overhead rows double, D moves a few times per block at most
+    size_t before = om_bytes(&dec->D), rows = P->L + 2 * dec->extra + 8;
+    om_grow(&dec->D, rows);
+    mem_account(rq, om_bytes(&dec->D), before);
+    dec->isi = realloc(dec->isi, (rows - lt) * sizeof(uint32_t));
+  }
+  dec->isi[r] = isi;
+  return lt + r;
+}
+
+// keeps a symbol of a block whose attempt is in flight until it is reaped
+static int repair_hold(nanorq *rq, struct repair_attempt *at, uint32_t esi,
+                       void *data, size_t T) {
+  if (bitmask_check(&at->held_mask, esi))
+    return NANORQ_SYM_DUP;
+  if (kv_size(at->held) == at->held_sym.rows) {
+    size_t grow = at->held_sym.rows ? 2 * at->held_sym.rows : 16;
+    size_t before = om_bytes(&at->held_sym);
+    if (at->held_sym.rows == 0)
+      om_resize(&at->held_sym, grow, T);
+    else
+      om_grow(&at->held_sym, grow);
+    mem_account(rq, om_bytes(&at->held_sym), before);
+  }
+  memcpy(om_R(at->held_sym, kv_size(at->held)), data, T);
+  kv_push(unsigned, at->held, esi);
+  bitmask_set(&at->held_mask, esi);
+  return NANORQ_SYM_ADDED;
+}
+
 int nanorq_decoder_add_symbol(nanorq *rq, void *data, uint32_t tag,
                               struct ioctx *io) {
   uint8_t sbn = (tag >> 24) & 0xff;
@@ -524,7 +976,7 @@ int nanorq_decoder_add_symbol(nanorq *rq, void *data, uint32_t tag,
   if (dec == NULL || esi > rq->max_esi)
     return NANORQ_SYM_ERR;
 
-  if (bitmask_gaps(&dec->repair_mask, dec->K) == 0) {
+  if (dec->missing == 0) {
     return NANORQ_SYM_IGN; // no repair needed.
   }
 
@@ -532,29 +984,62 @@ int nanorq_decoder_add_symbol(nanorq *rq, void *data, uint32_t tag,
   if (bitmask_check(&dec->repair_mask, esi))
     return NANORQ_SYM_DUP; // already got this esi
 
+  // D belongs to the attempt in flight
+  if (dec->attempt)
+    return repair_hold(rq, dec->attempt, esi, data, dec->D.cols);
 
   if (esi < dec->K) {
     // write original symbol to decode mat and output stream
-    memcpy(om_R(dec->D, rq->P.S + rq->P.H + esi), data, dec->D.cols);
+    size_t row = place_symbol(rq, dec, esi, true);
+    memcpy(om_R(dec->D, row), data, dec->D.cols);
     transfer_esi(rq, sbn, esi, dec->K, data, dec->D.cols, io, 1);
+    dec->sources++;
+    block_mark(rq, dec, esi);
+    if (dec->inc) {
+      inc_add_source(dec, esi, rq->P.S + rq->P.H + esi);
+      inc_try_solve(rq, sbn, dec, io);
+    }
+    return NANORQ_SYM_ADDED;
+  }
+
+  dec->repairs++;
+  if (rq->incremental && dec->inc == NULL)
+    dec->inc = inc_new(rq, dec);
+  if (dec->inc) {
+    inc_add_repair(rq, dec, esi, data);
+    block_mark(rq, dec, esi);
+    inc_try_solve(rq, sbn, dec, io);
+    return NANORQ_SYM_ADDED;
   } else {
-    // save repair symbol for precode patching
-    repair_sym rs = {esi, OM_INITIAL};
-    om_resize(&rs.row, 1, dec->D.cols);
-    memcpy(om_R(rs.row, 0), data, dec->D.cols);
-    kv_push(repair_sym, dec->repair_bin, rs);
+    // the repair symbol lands in D, its isi patches the precode matrix
+    size_t row = place_symbol(rq, dec, esi + (rq->P.Kprime - dec->K), false);
+    memcpy(om_R(dec->D, row), data, dec->D.cols);
   }
-  bitmask_set(&dec->repair_mask, esi);
+  block_mark(rq, dec, esi);
 
   return NANORQ_SYM_ADDED;
 }
 
+bool nanorq_set_incremental_max(nanorq *rq, uint32_t max_kprime) {
+  // a block keeps the decoder its first symbol started
+  for (size_t sbn = 0; sbn < nanorq_blocks(rq); sbn++) {
+    if (rq->encoders[sbn])
+      return false;
+  }
+  rq->incremental = (rq->P.Kprime <= max_kprime);
+  return true;
+}
+
+void nanorq_set_full_inactivation(nanorq *rq, bool enable) {
+  rq->strategy = enable ? PRECODE_RFC6330 : PRECODE_FAST;
+}
+
 size_t nanorq_num_missing(nanorq *rq, uint8_t sbn) {
   struct block_encoder *dec = get_block_encoder(rq, sbn);
   if (dec == NULL)
     return 0;
 
-  return bitmask_gaps(&dec->repair_mask, dec->K);
+  return dec->missing;
 }
 
 size_t nanorq_num_repair(nanorq *rq, uint8_t sbn) {
@@ -562,111 +1047,220 @@ size_t nanorq_num_repair(nanorq *rq, uint8_t sbn) {
   if (dec == NULL)
     return 0;
 
-  return kv_size(dec->repair_bin);
+  return dec->repairs;
 }
 
-static void patch_precode_matrix(params *P, spmat *A, uint16_t K, int num_gaps,
-                                 bitmask *mask, repair_vec *repair_bin) {
-  size_t padding = P->Kprime - K;
-  int rep_idx = 0;
-  for (int gap = 0; gap < P->L && num_gaps > 0; gap++) {
-    if (bitmask_check(mask, gap))
-      continue;
-    int row = gap + P->H + P->S;
-    uint32_t esi = kv_A(*repair_bin, rep_idx++).esi + padding;
-
-    spmat_clear_row(A, row);
-    params_set_idxs(esi, P, &A->idxs[row]);
-    num_gaps--;
-  }
-
-  for (int row = P->L; row < A->rows; row++) {
-    uint32_t esi = kv_A(*repair_bin, rep_idx++).esi + padding;
-    spmat_clear_row(A, row);
-    params_set_idxs(esi, P, &A->idxs[row]);
-  }
-}
-
-static void fill_symbol_matrix_gaps(params *P, octmat *D, uint16_t K,
-                                    bitmask *repair_mask,
-                                    repair_vec *repair_bin) {
-  int rep_idx = 0, skip = P->S + P->H, num_repair = kv_size(*repair_bin);
-  for (int gap = 0; gap < K && rep_idx < num_repair; gap++) {
-    if (bitmask_check(repair_mask, gap))
-      continue;
-    int row = skip + gap;
-    repair_sym rs = kv_A(*repair_bin, rep_idx++);
-    memcpy(om_R(*D, row), om_P(rs.row), D->cols);
-  }
-
-  for (int row = P->L; rep_idx < num_repair; row++) {
-    repair_sym rs = kv_A(*repair_bin, rep_idx++);
-    memcpy(om_R(*D, row), om_P(rs.row), D->cols);
-  }
+size_t nanorq_decoder_progress(nanorq *rq, uint8_t sbn, size_t *sources,
+                               size_t *repairs, size_t *missing) {
+  // blocks nothing arrived for yet are not created just to report on them
+  struct block_encoder *dec = rq->encoders[sbn];
+  if (sources)
+    *sources = dec ? dec->sources : 0;
+  if (repairs)
+    *repairs = dec ? dec->repairs : 0;
+  if (missing)
+    *missing = dec ? dec->missing : nanorq_block_symbols(rq, sbn);
+  return rq->blocks_left;
 }
 
-static void decode_repair_rows(params *P, octmat *D, octmat *M, uint16_t K,
-                               int num_gaps, bitmask *repair_mask) {
-  om_resize(M, num_gaps, D->cols);
-  for (int gap = 0, row = 0; gap < K && num_gaps > 0; gap++) {
-    if (bitmask_check(repair_mask, gap))
-      continue;
-    decode_row(P, D, gap, om_R(*M, row), M->cols);
-    row++;
-    num_gaps--;
+static void decode_repair_rows(arena *mem, params *P, octmat *D, octmat *M,
+                               uint16_t K, int num_gaps, bitmask *repair_mask) {
+  arena_octmat(mem, M, num_gaps, D->cols);
+  uint32_t *gaps = arena_alloc(mem, num_gaps * sizeof(uint32_t));
+  tuple *ts = arena_alloc(mem, num_gaps * sizeof(tuple));
+  int n = 0;
+  for (int gap = 0; gap < K && n < num_gaps; gap++) {
+    if (!bitmask_check(repair_mask, gap))
+      gaps[n++] = gap;
   }
+  gen_tuples(P, gaps, 0, n, ts);
+  for (int row = 0; row < n; row++)
+    decode_tuple(P, D, ts[row], M, row);
+  arena_release(mem, ts);
+  arena_release(mem, gaps);
 }
 
-static void write_repair_rows(nanorq *rq, uint8_t sbn, uint16_t K,
-                              struct ioctx *io, octmat *M,
-                              bitmask *repair_mask) {
+static void write_repair_rows(nanorq *rq, uint8_t sbn,
+                              struct block_encoder *dec, struct ioctx *io,
+                              octmat *M) {
+  uint16_t K = dec->K;
   for (int row = 0, miss_row = 0; row < K && miss_row < M->rows; row++) {
-    if (bitmask_check(repair_mask, row))
+    if (bitmask_check(&dec->repair_mask, row))
       continue;
     transfer_esi(rq, sbn, row, K, om_R(*M, miss_row), M->cols, io, 1);
-    bitmask_set(repair_mask, row);
+    block_mark(rq, dec, row);
     miss_row++;
   }
 }
 
+// inverts the precode matrix of dec and recovers its gaps missing source
+// symbols into M, touching nothing of rq but the D of dec and mem
+static bool repair_decode(nanorq *rq, struct block_encoder *dec, arena *mem,
+                          tpool *tp, int gaps, octmat *M) {
+  params *P = &rq->P;
+  // nothing of the last attempt is live any more, the arena starts over
+  arena_reset(mem);
+  // every LT row of D is taken now, the repair symbols left over sit past L
+  spmat *A = precode_matrix_gen(P, dec->isi, dec->extra, mem);
+
+  schedule *S = precode_matrix_invert(P, A, rq->strategy);
+  if (S == NULL)
+    return false;
+  sched_compile(S, false);
+  precode_matrix_intermediate(P, &dec->D, S, tp);
+  decode_repair_rows(mem, P, &dec->D, M, dec->K, gaps, &dec->repair_mask);
+  return true;
+}
+
+static bool repair_possible(struct block_encoder *dec) {
+  // the on arrival decoder finishes the block as soon as it has full rank
+  if (dec->inc || dec->attempt)
+    return false;
+  return dec->missing > 0 && dec->repairs >= dec->missing;
+}
+
 bool nanorq_repair_block(nanorq *rq, struct ioctx *io, uint8_t sbn) {
-  int overhead, num_repair, num_gaps;
   struct block_encoder *dec = get_block_encoder(rq, sbn);
   if (dec == NULL)
     return 0;
 
-  params *P = &rq->P;
-  octmat *D = &dec->D;
   octmat M = OM_INITIAL;
-  bitmask *repair_mask = &dec->repair_mask;
-  repair_vec *repair_bin = &dec->repair_bin;
-
-  num_repair = kv_size(*repair_bin);
-  num_gaps = bitmask_gaps(repair_mask, dec->K);
-  if (num_gaps == 0)
+  if (dec->missing == 0)
     return true;
-  if (num_repair < num_gaps)
+  if (!repair_possible(dec))
     return false;
-  overhead = num_repair - num_gaps;
+  if (rq->mem == NULL)
+    rq->mem = arena_new(0);
+  if (!repair_decode(rq, dec, rq->mem, rq->pool, dec->missing, &M))
+    return false;
+  mem_account(rq, om_bytes(&M), 0);
+  write_repair_rows(rq, sbn, dec, io, &M);
+  mem_account(rq, 0, om_bytes(&M));
+
+  return (nanorq_num_missing(rq, sbn) == 0);
+}
 
-  if (D->rows < P->L + overhead) {
+static void repair_run(void *arg, unsigned idx) {
+  struct repair_attempt *at = (struct repair_attempt *)arg;
+  struct block_encoder *dec = at->rq->encoders[at->sbn];
+  // the other workers run other blocks, D is replayed on this one alone
+  at->ok = repair_decode(at->rq, dec, at->mem, NULL, at->gaps, &at->M);
+  // publish D and M to the thread reaping the attempt
+  __atomic_store_n(&dec->pending, false, __ATOMIC_RELEASE);
+}
+
+bool nanorq_repair_async(nanorq *rq, uint8_t sbn, unsigned nthreads) {
+  struct block_encoder *dec = get_block_encoder(rq, sbn);
+  if (dec == NULL || !repair_possible(dec))
     return false;
+
+  // nobody waits on the attempt right away, so it needs at least one worker.
+  // the pool is only resized while no attempt runs on it
+  if (kv_size(rq->inflight) == 0 && rq->batch == NULL)
+    get_pool(rq, nthreads > 1 ? nthreads : 1);
+  struct repair_attempt *at = calloc(1, sizeof(struct repair_attempt));
+  at->rq = rq;
+  at->sbn = sbn;
+  at->gaps = dec->missing;
+  at->mem = kv_size(rq->arenas) > 0 ? kv_pop(rq->arenas) : arena_new(0);
+  at->M = (octmat)OM_INITIAL;
+  at->held_sym = (octmat)OM_INITIAL;
+  at->held_mask = bitmask_new(0);
+  dec->attempt = at;
+  dec->pending = true;
+  kv_push(uint8_t, rq->inflight, sbn);
+  at->batch = tpool_submit(rq->pool, 1, repair_run, at);
+  return true;
+}
+
+/* waits for the attempt of dec, writes what it recovered to io and adds the
+ * symbols held back meanwhile. without io the attempt is only dropped */
+static void repair_reap(nanorq *rq, struct block_encoder *dec, uint8_t sbn,
+                        struct ioctx *io) {
+  struct repair_attempt *at = dec->attempt;
+  tpool_wait(at->batch);
+  dec->attempt = NULL;
+  for (size_t it = 0; it < kv_size(rq->inflight); it++) {
+    if (kv_A(rq->inflight, it) != sbn)
+      continue;
+    memmove(rq->inflight.a + it, rq->inflight.a + it + 1,
+            kv_size(rq->inflight) - it - 1);
+    kv_size(rq->inflight)--;
+    break;
   }
 
-  fill_symbol_matrix_gaps(P, D, dec->K, repair_mask, repair_bin);
-  spmat *A = precode_matrix_gen(P, overhead);
-  patch_precode_matrix(P, A, dec->K, num_gaps, repair_mask, repair_bin);
+  if (at->ok && io) {
+    mem_account(rq, om_bytes(&at->M), 0);
+    write_repair_rows(rq, sbn, dec, io, &at->M);
+    mem_account(rq, 0, om_bytes(&at->M));
+  }
+  // symbols of a block the attempt completed are ignored here
+  for (size_t it = 0; io && it < kv_size(at->held); it++)
+    nanorq_decoder_add_symbol(rq, om_R(at->held_sym, it),
+                              nanorq_tag(sbn, kv_A(at->held, it)), io);
+  mem_account(rq, 0, om_bytes(&at->held_sym));
+  om_destroy(&at->held_sym);
+  kv_destroy(at->held);
+  bitmask_free(&at->held_mask);
+  kv_push(arena *, rq->arenas, at->mem);
+  free(at);
+}
 
-  schedule *S = precode_matrix_invert(P, A);
-  if (S == NULL) {
-    om_destroy(&M);
-    return false;
+int nanorq_repair_reap(nanorq *rq, struct ioctx *io, bool wait,
+                       bool *repaired) {
+  size_t n = kv_size(rq->inflight), it = 0;
+  while (it < n && block_pending(rq->encoders[kv_A(rq->inflight, it)]))
+    it++;
+  if (it == n) {
+    if (!wait || n == 0)
+      return -1;
+    it = 0; // the oldest attempt is the likeliest to finish first
   }
-  precode_matrix_intermediate(P, D, S);
-  sched_free(S);
-  decode_repair_rows(P, D, &M, dec->K, num_gaps, repair_mask);
-  write_repair_rows(rq, sbn, dec->K, io, &M, repair_mask);
-  om_destroy(&M);
 
-  return (nanorq_num_missing(rq, sbn) == 0);
+  uint8_t sbn = kv_A(rq->inflight, it);
+  struct block_encoder *dec = rq->encoders[sbn];
+  repair_reap(rq, dec, sbn, io);
+  if (repaired)
+    *repaired = (dec->missing == 0);
+  return sbn;
+}
+
+void nanorq_encoder_cleanup(nanorq *rq, uint8_t sbn) {
+  if (!rq->encoders[sbn])
+    return;
+  struct block_encoder *enc = rq->encoders[sbn];
+  if (enc->attempt)
+    repair_reap(rq, enc, sbn, NULL);
+  // comes back with every source symbol missing
+  if (enc->missing == 0 && enc->K > 0)
+    rq->blocks_left++;
+  mem_account(rq, 0, om_bytes(&enc->D) + om_bytes(&enc->sym));
+  om_destroy(&enc->D);
+  om_destroy(&enc->sym);
+  free(enc->isi);
+  if (kv_size(enc->repair_mask) > 0)
+    bitmask_free(&enc->repair_mask);
+  inc_free(rq, enc);
+  free(enc);
+  rq->encoders[sbn] = NULL;
+}
+
+void nanorq_encoder_reset(nanorq *rq, uint8_t sbn) {
+  if (!rq->encoders[sbn])
+    return;
+  struct block_encoder *enc = rq->encoders[sbn];
+  if (enc->attempt)
+    repair_reap(rq, enc, sbn, NULL);
+  enc->loaded = false;
+  enc->inverted = false;
+  if (om_P(enc->D))
+    memset(om_P(enc->D), 0, enc->D.rows * enc->D.cols_al);
+  free(enc->isi);
+  enc->isi = NULL;
+  enc->sources = enc->repairs = enc->hole = enc->extra = 0;
+  if (enc->missing == 0 && enc->K > 0)
+    rq->blocks_left++;
+  enc->missing = enc->K;
+  if (kv_size(enc->repair_mask) > 0)
+    bitmask_reset(&enc->repair_mask);
 }
@@ -12,6 +12,8 @@
 #define NANORQ_SYM_ADDED 0
 #define NANORQ_SYM_ERR -1
 #define NANORQ_MAX_TRANSFER 946270874880ULL // ~881 GB
+// default largest K' a decoder eliminates symbols of on arrival
+#define NANORQ_INC_MAX_KPRIME 2048
 
 typedef struct nanorq nanorq;
 
@@ -23,6 +25,22 @@ nanorq *nanorq_encoder_new_ex(size_t len, uint16_t T, uint16_t K, uint16_t Z,
 // returns success of generating symbols for a given sbn
 bool nanorq_generate_symbols(nanorq *rq, uint8_t sbn, struct ioctx *io);
 
+// returns success of generating symbols for every sbn, inverting up to
+// nthreads blocks concurrently
+bool nanorq_generate_all_symbols(nanorq *rq, struct ioctx *io,
+                                 unsigned nthreads);
+
+// load every sbn and queue their inversion on up to nthreads background
+// threads, source symbols can be encoded right away and repair symbols of
+// a block once nanorq_block_ready() says so
+bool nanorq_generate_async(nanorq *rq, struct ioctx *io, unsigned nthreads);
+
+// returns whether repair symbols of sbn can be encoded
+bool nanorq_block_ready(nanorq *rq, uint8_t sbn);
+
+// wait for background inversion, returns whether every sbn got inverted
+bool nanorq_generate_wait(nanorq *rq);
+
 // frees up any resources used by a decoder/encoder
 void nanorq_free(nanorq *rq);
 
@@ -50,13 +68,37 @@ uint32_t nanorq_tag(uint8_t sbn, uint32_t esi);
 // return the max number of blocks allowed
 size_t nanorq_max_blocks(nanorq *rq);
 
+// returns the high water mark of symbol storage held by rq, in bytes
+size_t nanorq_peak_memory(nanorq *rq);
+
+// reports the row ops of the encoding schedule before and after compilation
+// and the number of passes over destination rows they take
+bool nanorq_schedule_ops(nanorq *rq, size_t *raw, size_t *ops,
+                         size_t *passes);
+
 // precalculate precode matrix inversion
 bool nanorq_precalculate(nanorq *rq);
 
+// merge precode schedules persisted in path into the process wide cache
+bool nanorq_cache_load(const char *path);
+
+// persist the schedule cache to path if it gained entries since the last load
+bool nanorq_cache_save(const char *path);
+
+// cap the bytes cached for K' no live encoder or decoder uses, the least
+// recently used go first. the default is 16 MiB
+void nanorq_cache_limit(size_t bytes);
+
 // return the number of bytes written for a given sbn and esi encode request
 size_t nanorq_encode(nanorq *rq, void *data, uint32_t esi, uint8_t sbn,
                      struct ioctx *io);
 
+// encode count consecutive symbols of sbn starting at esi_start, symbol n is
+// written to out + n * stride, returns the number of symbols written
+size_t nanorq_encode_batch(nanorq *rq, uint8_t sbn, uint32_t esi_start,
+                           size_t count, uint8_t *out, size_t stride,
+                           struct ioctx *io);
+
 // cleanup encoder resources of a given block
 void nanorq_encoder_cleanup(nanorq *rq, uint8_t sbn);
 
@@ -73,15 +115,47 @@ bool nanorq_set_max_esi(nanorq *rq, uint32_t max_esi);
 int nanorq_decoder_add_symbol(nanorq *rq, void *data, uint32_t tag,
                               struct ioctx *io);
 
+// decode blocks whose K' is at most max_kprime on arrival, which costs more
+// CPU overall than one inversion but leaves almost nothing to do after the
+// last needed symbol. larger blocks wait for nanorq_repair_block or
+// nanorq_repair_async, 0 sends every block there. returns false once symbols
+// were added, the default is NANORQ_INC_MAX_KPRIME
+bool nanorq_set_incremental_max(nanorq *rq, uint32_t max_kprime);
+
+// use the RFC 6330 5.4.2.2 row selection with component and original degree
+// tracking when nanorq_repair_block inverts, rather than the faster default.
+// blocks decoded on arrival, see nanorq_set_incremental_max, run a plain
+// Gauss-Jordan elimination with no row selection and are not affected
+void nanorq_set_full_inactivation(nanorq *rq, bool enable);
+
 // returns number of symbol gaps in decoder for given block
 size_t nanorq_num_missing(nanorq *rq, uint8_t sbn);
 
 // returns number of repair symbols in decoder for given block
 size_t nanorq_num_repair(nanorq *rq, uint8_t sbn);
 
+// reports the source and repair symbols received for sbn and the source
+// symbols it still misses, any of them may be NULL. returns the number of
+// blocks still missing source symbols, 0 once the whole transfer is in.
+// O(1), the counts are kept as symbols arrive
+size_t nanorq_decoder_progress(nanorq *rq, uint8_t sbn, size_t *sources,
+                               size_t *repairs, size_t *missing);
+
 // return whether or not sbn was successfully repaired
 bool nanorq_repair_block(nanorq *rq, struct ioctx *io, uint8_t sbn);
 
+// queue an attempt to repair sbn on up to nthreads background threads,
+// returns false when sbn cannot be repaired yet or an attempt is in flight.
+// symbols of sbn added meanwhile are held back until the attempt is reaped
+bool nanorq_repair_async(nanorq *rq, uint8_t sbn, unsigned nthreads);
+
+// finish one attempt whose inversion is done, writing the recovered symbols
+// to io. with wait set, waits for the oldest attempt if none is done yet.
+// returns its sbn and sets repaired when the block is complete, -1 if no
+// attempt was reaped. only the thread adding symbols may call this
+int nanorq_repair_reap(nanorq *rq, struct ioctx *io, bool wait,
+                       bool *repaired);
+
 // HERMES size optimized...
 uint8_t *nanorq_tag_reduced(uint8_t sbn, uint32_t esi, uint8_t *buffer); // 3 bytes
 uint8_t *nanorq_oti_scheme_specific_align1(nanorq *rq, uint8_t *buffer); // 3 bytes
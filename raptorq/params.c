@@ -1,6 +1,4 @@
 #include "params.h"
-#include "rand.h"
-#include "tuple.h"
 
 static bool is_prime(uint16_t n) {
   if (n <= 1)
@@ -41,25 +39,9 @@ params params_init(uint16_t K) {
   while (!is_prime(P.P1))
     P.P1++;
 
+  P.divW = params_div_init(P.W);
+  P.divW1 = params_div_init(P.W - 1);
+  P.divP1 = params_div_init(P.P1);
+  P.divP11 = params_div_init(P.P1 - 1);
   return P;
 }
-
-void params_set_idxs(uint32_t X, params *P, uint_vec *dst) {
-  tuple t = gen_tuple(X, P);
-
-  kv_push(unsigned, *dst, t.b);
-  for (unsigned j = 1; j < t.d; j++) {
-    t.b = (t.b + t.a) % P->W;
-    kv_push(unsigned, *dst, t.b);
-  }
-  while (t.b1 >= P->P)
-    t.b1 = (t.b1 + t.a1) % P->P1;
-
-  kv_push(unsigned, *dst, P->W + t.b1);
-  for (unsigned j = 1; j < t.d1; j++) {
-    t.b1 = (t.b1 + t.a1) % P->P1;
-    while (t.b1 >= P->P)
-      t.b1 = (t.b1 + t.a1) % P->P1;
-    kv_push(unsigned, *dst, P->W + t.b1);
-  }
-}
@@ -5,6 +5,18 @@
 #include "util.h"
 #include <stdbool.h>
 
+// reciprocal of a divisor d below 2^16, see params_mod
+typedef struct {
+  uint64_t M;
+  uint32_t d;
+} params_div;
+
+#define params_div_init(d) ((params_div){UINT64_MAX / (d) + 1, (d)})
+#define params_mulhi_(l, d)                                                    \
+  ((((l) >> 32) * (d) + ((((l)&0xffffffff) * (d)) >> 32)) >> 32)
+// n % q.d for any 32 bit n, two multiplies instead of a division (Lemire)
+#define params_mod(n, q) ((uint32_t)params_mulhi_((q).M * (uint32_t)(n), (q).d))
+
 typedef struct {
   uint16_t Kprime;
   uint16_t S;
@@ -16,9 +28,10 @@ typedef struct {
   uint16_t U;
   uint16_t B;
   uint16_t J;
+  /* divisors of the tuple generator */
+  params_div divW, divW1, divP1, divP11; /* W, W - 1, P1, P1 - 1 */
 } params;
 
 params params_init(uint16_t symbols);
-void params_set_idxs(uint32_t X, params *P, uint_vec *dst);
 
 #endif
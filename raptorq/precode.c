@@ -1,34 +1,67 @@
 #include "precode.h"
+#include "cache.h"
+#include "tuple.h"
+
+// bytes of D kept in cache while a stripe replays the schedule, 0 splits D
+// only across threads
+#ifndef PRECODE_STRIPE_BYTES
+#define PRECODE_STRIPE_BYTES 0
+#endif
+// narrower stripes lose more to per op overhead than they gain in cache
+#define PRECODE_STRIPE_MIN 512
+// stripe widths stay a multiple of every backend's row alignment
+#define PRECODE_STRIPE_ALIGN 64
+// sources of a fused group handed to one oaxpy_multi call
+#define PRECODE_MULTI_ROWS 16
+// columns per Four Russians panel, each table takes 2^k rows
+#define PRECODE_M4RI_K 8
+
+/* the schedule leaves intermediate symbol c[j] in row d[j] of D, and the
+ * rows past L in the order d gives them, both orders go in one pass */
+static void precode_matrix_permute(octmat *D, schedule *S) {
+  int *from = arena_alloc(S->mem, sizeof(int) * D->rows);
+  uint8_t *tmp = arena_alloc(S->mem, D->cols_al);
+  for (int row = 0; row < D->rows; row++)
+    from[row] = (row < S->rows) ? S->d[row] : row;
+  for (int col = 0; col < S->cols; col++)
+    from[S->c[col]] = S->d[col];
+  om_permute(D, from, tmp);
+  arena_release(S->mem, tmp);
+  arena_release(S->mem, from);
+}
 
-static void precode_matrix_permute(octmat *D, int P[], int n) {
-  for (int i = 0; i < n; i++) {
-    int at = i, mark = -1;
-    while (P[at] >= 0) {
-      oswaprow(om_P(*D), i, P[at], D->cols);
-      int tmp = P[at];
-      P[at] = mark;
-      at = tmp;
+/* columns [s, s + w) of D, the unit the schedule is replayed over */
+typedef struct {
+  octmat *D;
+  schedule *S;
+  size_t w;
+} precode_stripes;
+
+static void precode_matrix_apply_sched(octmat *D, schedule *S, size_t s,
+                                       size_t w) {
+  uint32_t *code = S->prog.code, *end = code + S->prog.len;
+  while (code < end) {
+    uint8_t *a = om_R(*D, code[0]) + s;
+    uint32_t n = code[1] >> 8;
+    if ((code[1] & 0xff) != 1)
+      oscal(a, 0, w, code[1] & 0xff);
+    for (code += 2; n > 0;) {
+      uint8_t *src[PRECODE_MULTI_ROWS], beta[PRECODE_MULTI_ROWS];
+      uint32_t m = n < PRECODE_MULTI_ROWS ? n : PRECODE_MULTI_ROWS;
+      for (uint32_t i = 0; i < m; i++, code++) {
+        src[i] = om_R(*D, *code >> 8) + s;
+        beta[i] = *code & 0xff;
+      }
+      oaxpy_multi(a, src, beta, m, w);
+      n -= m;
     }
   }
 }
 
-static void precode_matrix_apply_op(octmat *D, schedule *S, int i) {
-  sched_op op = kv_A(S->ops, i);
-  if (op.beta)
-    oaxpy(om_P(*D), om_P(*D), op.i, op.j, D->cols, op.beta);
-  else
-    oscal(om_P(*D), op.i, D->cols, op.j);
-}
-
-static void precode_matrix_apply_sched(octmat *D, schedule *S) {
-  for (int i = 0; i < S->marks[1]; i++)
-    precode_matrix_apply_op(D, S, i);
-  for (int i = S->marks[0]; i >= 0; i--)
-    precode_matrix_apply_op(D, S, i);
-  for (int i = S->marks[1]; i < kv_size(S->ops); i++)
-    precode_matrix_apply_op(D, S, i);
-  for (int i = 0; i <= S->marks[0]; i++)
-    precode_matrix_apply_op(D, S, i);
+static void precode_matrix_apply_stripe(void *arg, unsigned idx) {
+  precode_stripes *ps = (precode_stripes *)arg;
+  size_t s = idx * ps->w, w = ps->D->cols_al - s;
+  precode_matrix_apply_sched(ps->D, ps->S, s, w < ps->w ? w : ps->w);
 }
 
 static void precode_matrix_make_identity(spmat *A, int dim, int m, int n) {
@@ -57,42 +90,96 @@ static void precode_matrix_make_LDPC2(spmat *A, int W, int S, int P) {
   }
 }
 
-static octmat precode_matrix_make_HDPC(params *P) {
+octmat *precode_matrix_HDPC(params *P) {
   int m = P->H;
   int n = P->Kprime + P->S;
 
   assert(m > 0 && n > 0);
-  octmat HDPC = OM_INITIAL;
-  om_resize(&HDPC, m, n);
+  octmat *HDPC = calloc(1, sizeof(octmat));
+  om_resize(HDPC, m, n);
 
   for (int row = 0; row < m; row++)
-    om_A(HDPC, row, n - 1) = OCT_EXP[row];
+    om_A(*HDPC, row, n - 1) = OCT_EXP[row];
 
   for (int col = n - 2; col >= 0; col--) {
     for (int row = 0; row < m; row++)
-      om_A(HDPC, row, col) =
-          (om_A(HDPC, row, col + 1) == 0)
+      om_A(*HDPC, row, col) =
+          (om_A(*HDPC, row, col + 1) == 0)
               ? 0
-              : OCT_EXP[OCT_LOG[om_A(HDPC, row, col + 1)] + 1];
+              : OCT_EXP[OCT_LOG[om_A(*HDPC, row, col + 1)] + 1];
     int b1 = rnd_get(col + 1, 6, m);
     int b2 = (b1 + rnd_get(col + 1, 7, m - 1) + 1) % m;
-    om_A(HDPC, b1, col) ^= 1;
-    om_A(HDPC, b2, col) ^= 1;
+    om_A(*HDPC, b1, col) ^= 1;
+    om_A(*HDPC, b2, col) ^= 1;
   }
   return HDPC;
 }
 
-static void precode_matrix_make_G_ENC(spmat *A, params *P) {
-  for (int row = P->S + P->H; row < P->L; row++)
-    params_set_idxs(row - P->S - P->H, P, &A->idxs[row]);
+static void precode_matrix_make_G_ENC(spmat *A, params *P, tuple *ts) {
+  for (int row = P->S + P->H; row < A->rows; row++) {
+    tuple t = ts[row - P->S - P->H];
+    unsigned *dst = spmat_reserve(A, row, tuple_len(t));
+    if (dst)
+      tuple_idxs(t, P, dst);
+  }
 }
 
-spmat *precode_matrix_gen(params *P, int overhead) {
-  spmat *A = spmat_new(P->L + overhead, P->L);
-  precode_matrix_make_LDPC1(A, P->S, P->B);
-  precode_matrix_make_identity(A, P->S, 0, P->B);
-  precode_matrix_make_LDPC2(A, P->W, P->S, P->P);
-  precode_matrix_make_G_ENC(A, P);
+spmat *precode_matrix_base(params *P) {
+  spmat *A = spmat_new(P->L, P->L, NULL);
+  tuple *ts = malloc(P->Kprime * sizeof(tuple));
+  gen_tuples(P, NULL, 0, P->Kprime, ts);
+
+  for (int pass = 0; pass < 2; pass++) {
+    if (pass)
+      spmat_alloc(A);
+    precode_matrix_make_LDPC1(A, P->S, P->B);
+    precode_matrix_make_identity(A, P->S, 0, P->B);
+    precode_matrix_make_LDPC2(A, P->W, P->S, P->P);
+    precode_matrix_make_G_ENC(A, P, ts);
+  }
+  free(ts);
+  return A;
+}
+
+// whether LT row l holds an isi the base matrix has no row for
+#define precode_row_moved(P, isi, l)                                           \
+  ((l) >= (P)->Kprime || ((isi) && (isi)[l] != (uint32_t)(l)))
+
+/* clones the cached base matrix, only the LT rows of an isi other than their
+ * own and the overhead rows get tuples of their own */
+spmat *precode_matrix_gen(params *P, const uint32_t *isi, int overhead,
+                          arena *mem) {
+  const spmat *base = cache_precode(P);
+  spmat *A = spmat_new(P->L + overhead, P->L, mem);
+  int n = P->Kprime + overhead, lt = P->S + P->H, m = 0;
+  uint32_t *moved = arena_alloc(mem, n * sizeof(uint32_t));
+  for (int l = 0; l < n; l++) {
+    if (precode_row_moved(P, isi, l))
+      moved[m++] = isi ? isi[l] : l;
+  }
+  tuple *ts = arena_alloc(mem, m * sizeof(tuple));
+  gen_tuples(P, moved, 0, m, ts);
+
+  for (int pass = 0; pass < 2; pass++) {
+    if (pass)
+      spmat_alloc(A);
+    for (int row = 0, t = 0; row < A->rows; row++) {
+      int l = row - lt;
+      if (row >= lt && precode_row_moved(P, isi, l)) {
+        unsigned *dst = spmat_reserve(A, row, tuple_len(ts[t]));
+        if (dst)
+          tuple_idxs(ts[t], P, dst);
+        t++;
+      } else {
+        unsigned len = spmat_row_len(base, row);
+        unsigned *dst = spmat_reserve(A, row, len);
+        if (dst)
+          memcpy(dst, spmat_row(base, row), len * sizeof(unsigned));
+      }
+    }
+  }
+  arena_release(mem, ts);
+  arena_release(mem, moved);
   return A;
 }
 
@@ -108,16 +195,43 @@ static void precode_matrix_sort(params *P, spmat *A, schedule *S) {
   }
 }
 
+/* rows of V bucketed by their number of ones in V */
+typedef struct {
+  unsigned n;
+  uint_vec *rows;
+  arena *mem;
+} precode_nzt;
+
+static precode_nzt *precode_nzt_new(unsigned n, arena *mem) {
+  precode_nzt *NZT = arena_calloc(mem, 1, sizeof(precode_nzt));
+  NZT->n = n;
+  NZT->rows = arena_calloc(mem, n, sizeof(uint_vec));
+  NZT->mem = mem;
+  return NZT;
+}
+
+#define precode_nzt_push(NZT, b, row)                                          \
+  arena_kv_push((NZT)->mem, unsigned, (NZT)->rows[b], row)
+
+static void precode_nzt_free(precode_nzt *NZT) {
+  arena *mem = NZT->mem;
+  for (unsigned b = 0; b < NZT->n; b++)
+    arena_release(mem, NZT->rows[b].a);
+  arena_release(mem, NZT->rows);
+  arena_release(mem, NZT);
+}
+
 /* shortcuts are taken here
+ *  - only rows with one or two ones in V are chosen, the rest of V is
+ *    inactivated at once and left to the dense GF(2) solve
  *  - component / original degree tracking is skipped for speed
- *  - it might result in decoding failures until more symbols are added
  */
 static int precode_matrix_choose(int V0, int Vrows, int Srows, int Vcols,
-                                 schedule *S, spmat *NZT) {
+                                 schedule *S, precode_nzt *NZT) {
   int chosen = Vrows;
   for (int b = 1; b < 3; b++) {
-    while (kv_size(NZT->idxs[b]) > 0) {
-      chosen = kv_pop(NZT->idxs[b]);
+    while (kv_size(NZT->rows[b]) > 0) {
+      chosen = kv_pop(NZT->rows[b]);
       if (S->di[chosen] >= V0 && S->nz[chosen] == b)
         return S->di[chosen];
     }
@@ -128,9 +242,9 @@ static int precode_matrix_choose(int V0, int Vrows, int Srows, int Vcols,
 int precode_row_nz_at(spmat *A, int row, int s, int e, schedule *S, int *at) {
   int r = 0;
   at[0] = at[1] = e;
-  uint_vec rs = A->idxs[S->d[row]];
-  for (int it = 0; it < kv_size(rs) && r < S->nz[S->d[row]]; it++) {
-    int col = S->ci[kv_A(rs, it)];
+  unsigned *rs = spmat_row(A, S->d[row]), n = spmat_row_len(A, S->d[row]);
+  for (int it = 0; it < n && r < S->nz[S->d[row]]; it++) {
+    int col = S->ci[rs[it]];
     if (col >= s && col < e)
       at[r++] = col;
   }
@@ -139,6 +253,120 @@ int precode_row_nz_at(spmat *A, int row, int s, int e, schedule *S, int *at) {
   return r;
 }
 
+/* state of the RFC 6330 5.4.2.2 row selection */
+typedef struct {
+  precode_nzt *NZT;
+  unsigned *deg; /* original degree of each row */
+  int *up;       /* union-find over columns for the graph of r = 2 rows */
+  int *size;
+  int *seen; /* step a column was last reset in */
+  int *ones; /* columns of the chosen row, or of the r = 2 rows */
+  int step;
+} precode_rfc;
+
+static int precode_rfc_find(precode_rfc *R, int col) {
+  if (R->seen[col] != R->step) {
+    R->seen[col] = R->step;
+    R->up[col] = col;
+    R->size[col] = 1;
+  }
+  while (R->up[col] != col)
+    col = R->up[col] = R->up[R->up[col]];
+  return col;
+}
+
+static void precode_rfc_union(precode_rfc *R, int a, int b) {
+  a = precode_rfc_find(R, a);
+  b = precode_rfc_find(R, b);
+  if (a == b)
+    return;
+  if (R->size[a] < R->size[b])
+    TMPSWAP(int, a, b);
+  R->up[b] = a;
+  R->size[a] += R->size[b];
+}
+
+/* ones of V in row as original column ids */
+static int precode_rfc_ones(spmat *A, int row, int V0, int Vcols, schedule *S,
+                            int *at) {
+  int r = 0;
+  unsigned *rs = spmat_row(A, row), n = spmat_row_len(A, row);
+  for (int it = 0; it < n && r < S->nz[row]; it++) {
+    int col = S->ci[rs[it]];
+    if (col >= V0 && col < V0 + Vcols)
+      at[r++] = rs[it];
+  }
+  return r;
+}
+
+/* a row of the largest component of the r = 2 graph, whose nodes are the
+ * columns of V and whose edges are the rows with two ones in V */
+static int precode_rfc_component(precode_rfc *R, spmat *A, int V0, int Vcols,
+                                 schedule *S, uint_vec *rows) {
+  int n = kv_size(*rows), best = -1, best_size = 0;
+  R->step++;
+  for (int it = 0; it < n; it++) {
+    int *e = R->ones + 2 * it;
+    precode_rfc_ones(A, kv_A(*rows, it), V0, Vcols, S, e);
+    precode_rfc_union(R, e[0], e[1]);
+  }
+  for (int it = 0; it < n; it++) {
+    int sz = R->size[precode_rfc_find(R, R->ones[2 * it])];
+    if (sz > best_size) {
+      best_size = sz;
+      best = kv_A(*rows, it);
+    }
+  }
+  return best;
+}
+
+static int precode_matrix_choose_rfc(precode_rfc *R, spmat *A, int V0,
+                                     int Vcols, int Srows, schedule *S) {
+  precode_nzt *NZT = R->NZT;
+  for (int b = 1; b < NZT->n; b++) {
+    uint_vec *rows = &NZT->rows[b];
+    int n = 0;
+    // drop rows chosen already or whose count moved to a lower bucket
+    for (int it = 0; it < kv_size(*rows); it++) {
+      int row = kv_A(*rows, it);
+      if (S->di[row] >= V0 && S->di[row] < Srows && S->nz[row] == b)
+        kv_A(*rows, n++) = row;
+    }
+    kv_size(*rows) = n;
+    if (n == 0)
+      continue;
+
+    int chosen = kv_A(*rows, 0);
+    if (b == 2) {
+      chosen = precode_rfc_component(R, A, V0, Vcols, S, rows);
+    } else {
+      for (int it = 1; it < n; it++) {
+        int row = kv_A(*rows, it);
+        if (R->deg[row] < R->deg[chosen])
+          chosen = row;
+      }
+    }
+    return S->di[chosen];
+  }
+  return Srows;
+}
+
+/* first one of the chosen row to the front of V, the other r - 1 to its back
+ */
+static int precode_matrix_swap_cols_rfc(precode_rfc *R, spmat *A, int V0,
+                                        int Vcols, schedule *S) {
+  int *c = S->c, *ci = S->ci;
+  int r = precode_rfc_ones(A, S->d[V0], V0, Vcols, S, R->ones);
+  for (int k = 0; k < r; k++) {
+    int to = k ? V0 + Vcols - k : V0, from = ci[R->ones[k]];
+    if (from != to) {
+      TMPSWAP(int, c[to], c[from]);
+      TMPSWAP(int, ci[c[to]], ci[c[from]]);
+    }
+  }
+  return r;
+}
+
 static int precode_matrix_swap_cols(spmat *A, int V0, int Vcols, schedule *S) {
   int *c = S->c, *ci = S->ci, ones[2], Vlast = V0 + Vcols - 1;
   int r = precode_row_nz_at(A, V0, V0, V0 + Vcols, S, ones);
@@ -154,21 +382,15 @@ static int precode_matrix_swap_cols(spmat *A, int V0, int Vcols, schedule *S) {
 }
 
 static void precode_matrix_update_nnz(spmat *AT, int V0, int Vcols, int r,
-                                      schedule *S, spmat *NZT) {
-  uint_vec cs = AT->idxs[S->c[V0]];
-  for (int it = 0; it < kv_size(cs); it++) {
-    int row = kv_A(cs, it);
-    int nz = --S->nz[row];
-    if (nz > 0 && nz < 3)
-      spmat_push(NZT, nz, row);
-  }
-  for (int col = 0; col < r - 1; col++) {
-    cs = AT->idxs[S->c[V0 + Vcols - col - 1]];
-    for (int it = 0; it < kv_size(cs); it++) {
-      int row = kv_A(cs, it);
+                                      schedule *S, precode_nzt *NZT) {
+  for (int col = 0; col < r; col++) {
+    int c = S->c[col ? V0 + Vcols - col : V0];
+    unsigned *cs = spmat_row(AT, c), n = spmat_row_len(AT, c);
+    for (int it = 0; it < n; it++) {
+      int row = cs[it];
       int nz = --S->nz[row];
-      if (nz > 0 && nz < 3)
-        spmat_push(NZT, nz, row);
+      if (nz > 0 && nz < NZT->n)
+        precode_nzt_push(NZT, nz, row);
     }
   }
 }
@@ -178,10 +400,10 @@ static void precode_matrix_precond(params *P, spmat *A, spmat *AT,
   int i = 0, u = P->P, rows = A->rows, Srows = A->rows - P->H, cols = A->cols;
   int *d = S->d, *di = S->di;
 
-  spmat *NZT = spmat_new(3, rows);
+  precode_nzt *NZT = precode_nzt_new(3, S->mem);
   for (int row = 0; row < Srows; row++) {
     if (S->nz[S->d[row]] < 3)
-      spmat_push(NZT, S->nz[S->d[row]], S->d[row]);
+      precode_nzt_push(NZT, S->nz[S->d[row]], S->d[row]);
   }
   while (i + u < P->L) {
     int Vrows = rows - i, Vcols = cols - i - u, V0 = i;
@@ -197,7 +419,52 @@ static void precode_matrix_precond(params *P, spmat *A, spmat *AT,
     i++;
     u += r - 1;
   }
-  spmat_free(NZT);
+  precode_nzt_free(NZT);
+  S->i = i;
+  S->u = P->L - i;
+}
+
+/* RFC 6330 5.4.2.2: always take a row with the fewest ones r in V, from the
+ * largest component of the r = 2 graph or else of least original degree, and
+ * inactivate its other r - 1 columns, so fewer columns reach the dense solve
+ */
+static void precode_matrix_precond_rfc(params *P, spmat *A, spmat *AT,
+                                       schedule *S) {
+  int i = 0, u = P->P, rows = A->rows, Srows = A->rows - P->H, cols = A->cols;
+  int *d = S->d, *di = S->di;
+  precode_rfc R = {0};
+
+  R.NZT = precode_nzt_new(cols, S->mem);
+  R.deg = arena_calloc(S->mem, rows, sizeof(unsigned));
+  R.up = arena_calloc(S->mem, cols, sizeof(int));
+  R.size = arena_calloc(S->mem, cols, sizeof(int));
+  R.seen = arena_calloc(S->mem, cols, sizeof(int));
+  R.ones = arena_calloc(S->mem, 2 * rows + cols, sizeof(int));
+  for (int row = 0; row < Srows; row++) {
+    R.deg[d[row]] = S->nz[d[row]];
+    if (S->nz[d[row]] < cols)
+      precode_nzt_push(R.NZT, S->nz[d[row]], d[row]);
+  }
+  while (i + u < P->L) {
+    int Vcols = cols - i - u, V0 = i;
+    int chosen = precode_matrix_choose_rfc(&R, A, V0, Vcols, Srows, S);
+    if (chosen >= Srows)
+      break;
+    if (V0 != chosen) {
+      TMPSWAP(int, d[V0], d[chosen]);
+      TMPSWAP(int, di[d[V0]], di[d[chosen]]);
+    }
+    int r = precode_matrix_swap_cols_rfc(&R, A, V0, Vcols, S);
+    precode_matrix_update_nnz(AT, V0, Vcols, r, S, R.NZT);
+    i++;
+    u += r - 1;
+  }
+  precode_nzt_free(R.NZT);
+  arena_release(S->mem, R.deg);
+  arena_release(S->mem, R.up);
+  arena_release(S->mem, R.size);
+  arena_release(S->mem, R.seen);
+  arena_release(S->mem, R.ones);
   S->i = i;
   S->u = P->L - i;
 }
@@ -207,9 +474,9 @@ static void precode_matrix_fwd_GE(wrkmat *U, schedule *S, spmat *AT, int s,
   int *c = S->c, *d = S->d, *di = S->di;
   for (int row = 0; row < S->i; row++) {
     int mv = s < row ? row : s;
-    uint_vec cs = AT->idxs[c[row]];
-    for (int it = 0; it < kv_size(cs); it++) {
-      int tmp = kv_A(cs, it), h = di[tmp];
+    unsigned *cs = spmat_row(AT, c[row]), n = spmat_row_len(AT, c[row]);
+    for (int it = 0; it < n; it++) {
+      int tmp = cs[it], h = di[tmp];
       if (h > mv && h < e) {
         wrkmat_axpy(U, tmp, d[row], 1);
         sched_push(S, tmp, d[row], 1);
@@ -220,9 +487,9 @@ static void precode_matrix_fwd_GE(wrkmat *U, schedule *S, spmat *AT, int s,
 
 static void precode_matrix_fill_U(wrkmat *U, spmat *A, spmat *AT, schedule *S) {
   for (int i = 0; i < A->rows; i++) {
-    uint_vec rs = A->idxs[i];
-    for (int it = 0; it < kv_size(rs); it++) {
-      int col = S->ci[kv_A(rs, it)];
+    unsigned *rs = spmat_row(A, i), n = spmat_row_len(A, i);
+    for (int it = 0; it < n; it++) {
+      int col = S->ci[rs[it]];
       if (col >= S->i)
         wrkmat_set(U, i, col - S->i, 1);
     }
@@ -230,30 +497,43 @@ static void precode_matrix_fill_U(wrkmat *U, spmat *A, spmat *AT, schedule *S) {
 }
 
 static void precode_matrix_fill_HDPC(params *P, wrkmat *U, schedule *S) {
-  octmat UL = OM_INITIAL, HDPC = precode_matrix_make_HDPC(P);
-  om_resize(&UL, 2 * P->H, S->u);
+  const octmat *HDPC = cache_HDPC(P);
+  octmat UL = OM_INITIAL;
+  arena_octmat(S->mem, &UL, 2 * P->H, S->u);
   for (int row = 0; row < P->H; row++) {
     for (int col = 0; col < UL.cols - P->H; col++)
       om_A(UL, row, col) =
-          om_A(HDPC, row, S->c[HDPC.cols - (S->u - P->H) + col]);
+          om_A(*HDPC, row, S->c[HDPC->cols - (S->u - P->H) + col]);
     om_A(UL, row, row + (UL.cols - P->H)) = 1; // I_H
   }
   wrkmat_assign_block(U, &UL, P->S, 0, P->H, S->u);
-  for (int row = 0; row < S->i; row++) {
+
+  /* the rows above i are still gf2, each HDPC row gains its HDPC multiple of
+   * them, eight rows at a time through one packed row and oaxpy_b8 */
+  octmat B8 = OM_INITIAL;
+  arena_octmat(S->mem, &B8, 1, S->u);
+  for (int row = 0; row < S->i; row += 8) {
+    int n = (S->i - row < 8) ? S->i - row : 8, rows[8];
+    for (int s = 0; s < n; s++)
+      rows[s] = S->d[row + s];
+    gf2mat_pack8(U->GF2, rows, n, om_P(B8));
     for (int h = 0; h < P->H; h++) {
-      uint8_t beta = om_A(HDPC, h, S->c[row]);
-      if (beta) {
-        wrkmat_axpy(U, S->d[U->rows - P->H + h], S->d[row], beta);
-        sched_push(S, S->d[U->rows - P->H + h], S->d[row], beta);
+      int dst = S->d[U->rows - P->H + h];
+      uint8_t u[8] = {0};
+      for (int s = 0; s < n; s++) {
+        u[s] = om_A(*HDPC, h, S->c[row + s]);
+        if (u[s])
+          sched_push(S, dst, rows[s], u[s]);
       }
+      oaxpy_b8(om_P(U->GF256), om_P(B8), U->rowmap[dst], S->u, u);
     }
   }
-  om_destroy(&HDPC);
+  arena_octmat_release(S->mem, &B8);
 }
 
 static wrkmat *precode_matrix_make_U(params *P, spmat *A, spmat *AT,
                                      schedule *S) {
-  wrkmat *U = wrkmat_new(A->rows, S->u);
+  wrkmat *U = wrkmat_new(A->rows, S->u, S->mem);
   precode_matrix_fill_U(U, A, AT, S);
   precode_matrix_fwd_GE(U, S, AT, 0, S->i);
   S->marks[0] = kv_size(S->ops) - 1;
@@ -261,26 +541,86 @@ static wrkmat *precode_matrix_make_U(params *P, spmat *A, spmat *AT,
   return U;
 }
 
+/* clears the n panel columns from col on out of every row below the pivots
+ * row..row+n-1 with one table xor per row, T[v] holding the sum of the pivots
+ * selected by v over the words from col on */
+static void precode_matrix_clear_panel(wrkmat *U, schedule *S, gf2word *T,
+                                       int row, int col, int n, int rows) {
+  gf2mat *G = U->GF2;
+  int *d = S->d, w0 = col / gf2wsz, words = G->stride - w0;
+  for (unsigned v = 1; v < (1U << n); v++) {
+    gf2word *t = T + v * words, *u = T + (v & (v - 1)) * words;
+    gf2word *p = gf2row(G, d[row + __builtin_ctz(v)]) + w0;
+    for (int w = 0; w < words; w++)
+      t[w] = u[w] ^ p[w];
+  }
+  for (int del_row = row + n; del_row < rows; del_row++) {
+    unsigned v = gf2bits(G, d[del_row], col, n);
+    if (v == 0)
+      continue;
+    gf2word *t = T + v * words, *a = gf2row(G, d[del_row]) + w0;
+    for (int w = 0; w < words; w++)
+      a[w] ^= t[w];
+    for (; v; v &= v - 1)
+      sched_push(S, d[del_row], d[row + __builtin_ctz(v)], 1);
+  }
+}
+
+/* Method of Four Russians, eliminates up to PRECODE_M4RI_K columns at a time
+ * into reduced form, then clears them from the rows below in one pass */
 static int precode_matrix_solve_gf2(params *P, wrkmat *U, schedule *S) {
-  int *d = S->d, *di = S->di, row, nzrow, rows = U->rows - P->H;
-  for (row = S->i; row < P->L; row++) {
-    int col = row - S->i;
-    for (nzrow = row; nzrow < rows; nzrow++)
-      if (wrkmat_at(U, d[nzrow], col))
+  gf2mat *G = U->GF2;
+  int *d = S->d, *di = S->di, row = S->i, rows = U->rows - P->H;
+  gf2word *T =
+      arena_calloc(S->mem, (1U << PRECODE_M4RI_K) * G->stride, sizeof(gf2word));
+  unsigned Tc[1U << PRECODE_M4RI_K];
+
+  while (row < P->L) {
+    int col = row - S->i, n = P->L - row, k;
+    if (n > PRECODE_M4RI_K)
+      n = PRECODE_M4RI_K;
+    if (n > gf2wsz - col % gf2wsz)
+      n = gf2wsz - col % gf2wsz;
+
+    // Tc[v] is the panel bits of the sum of the pivots selected by v
+    Tc[0] = 0;
+    for (k = 0; k < n; k++) {
+      unsigned mask = (1U << k) - 1, v = 0;
+      int nzrow;
+      for (nzrow = row + k; nzrow < rows; nzrow++) {
+        v = gf2bits(G, d[nzrow], col, n);
+        if (((v ^ Tc[v & mask]) >> k) & 1)
+          break;
+      }
+      if (nzrow == rows)
         break;
-    if (nzrow == rows)
-      break;
-    if (row != nzrow) {
-      TMPSWAP(int, d[row], d[nzrow]);
-      TMPSWAP(int, di[d[row]], di[d[nzrow]]);
-    }
-    for (int del_row = row + 1; del_row < rows; del_row++) {
-      if (wrkmat_at(U, d[del_row], col) == 0)
-        continue;
-      wrkmat_axpy(U, d[del_row], d[row], 1);
-      sched_push(S, d[del_row], d[row], 1);
+      int pivot = row + k;
+      if (pivot != nzrow) {
+        TMPSWAP(int, d[pivot], d[nzrow]);
+        TMPSWAP(int, di[d[pivot]], di[d[nzrow]]);
+      }
+      for (unsigned b = v & mask; b; b &= b - 1) {
+        gf2mat_xor(G, G, d[pivot], d[row + __builtin_ctz(b)]);
+        sched_push(S, d[pivot], d[row + __builtin_ctz(b)], 1);
+      }
+      for (int prev = row; prev < pivot; prev++) {
+        if (gf2el(G, d[prev], col + k) == 0)
+          continue;
+        gf2mat_xor(G, G, d[prev], d[pivot]);
+        sched_push(S, d[prev], d[pivot], 1);
+      }
+      for (unsigned t = 0; t < (2U << k); t++) {
+        unsigned low = t & (t - 1);
+        Tc[t] = t ? Tc[low] ^ gf2bits(G, d[row + __builtin_ctz(t)], col, n) : 0;
+      }
     }
+    if (k > 0)
+      precode_matrix_clear_panel(U, S, T, row, col, k, rows);
+    row += k;
+    if (k < n)
+      break;
   }
+  arena_release(S->mem, T);
   return row;
 }
 
@@ -318,9 +658,9 @@ static void precode_matrix_backsolve(params *P, spmat *AT, wrkmat *U,
                                      schedule *S) {
   int *c = S->c, *d = S->d;
   for (int row = P->L - 1; row >= S->i; row--) {
-    uint_vec cs = AT->idxs[c[row]];
-    for (int it = 0; it < kv_size(cs); it++) {
-      int del_row = S->di[kv_A(cs, it)];
+    unsigned *cs = spmat_row(AT, c[row]), n = spmat_row_len(AT, c[row]);
+    for (int it = 0; it < n; it++) {
+      int del_row = S->di[cs[it]];
       if (del_row < S->i)
         sched_push(S, d[del_row], d[row], 1);
     }
@@ -344,15 +684,19 @@ static void *precode_matrix_cleanup(spmat *A, spmat *AT, schedule *S,
   return NULL;
 }
 
-schedule *precode_matrix_invert(params *P, spmat *A) {
+schedule *precode_matrix_invert(params *P, spmat *A,
+                                precode_strategy strategy) {
   int rows = A->rows, cols = A->cols;
-  schedule *S = sched_new(rows, cols, 3 * P->L);
+  schedule *S = sched_new(rows, cols, 3 * P->L, A->mem);
   wrkmat *U = NULL;
 
   precode_matrix_sort(P, A, S);
   spmat *AT = spmat_transpose(A);
 
-  precode_matrix_precond(P, A, AT, S);
+  if (strategy == PRECODE_RFC6330)
+    precode_matrix_precond_rfc(P, A, AT, S);
+  else
+    precode_matrix_precond(P, A, AT, S);
 
   U = precode_matrix_make_U(P, A, AT, S);
   if (U == NULL)
@@ -376,14 +720,26 @@ schedule *precode_matrix_invert(params *P, spmat *A) {
   return S;
 }
 
-void precode_matrix_intermediate(params *P, octmat *D, schedule *S) {
-  precode_matrix_apply_sched(D, S);
-  int *rm = calloc(sizeof(int), S->rows);
-  int *cm = calloc(sizeof(int), S->cols);
-  memcpy(rm, S->di, sizeof(int) * S->rows);
-  memcpy(cm, S->c, sizeof(int) * S->cols);
-  precode_matrix_permute(D, rm, S->rows);
-  precode_matrix_permute(D, cm, S->cols);
-  free(rm);
-  free(cm);
+/* columns are independent, so the schedule is replayed stripe by stripe with
+ * each stripe of D staying in cache, at least one stripe per thread */
+static size_t precode_stripe_width(octmat *D, unsigned threads) {
+  size_t stripes = 1 + threads, w;
+#if PRECODE_STRIPE_BYTES > 0
+  size_t bytes = D->rows * D->cols_al;
+  if (bytes / stripes > PRECODE_STRIPE_BYTES)
+    stripes = (bytes + PRECODE_STRIPE_BYTES - 1) / PRECODE_STRIPE_BYTES;
+#endif
+  w = (D->cols_al + stripes - 1) / stripes;
+  if (stripes > 1 + threads && w < PRECODE_STRIPE_MIN)
+    w = PRECODE_STRIPE_MIN;
+  return (w + PRECODE_STRIPE_ALIGN - 1) / PRECODE_STRIPE_ALIGN *
+         PRECODE_STRIPE_ALIGN;
+}
+
+void precode_matrix_intermediate(params *P, octmat *D, schedule *S,
+                                 tpool *tp) {
+  size_t w = precode_stripe_width(D, tpool_threads(tp));
+  precode_stripes ps = {D, S, w};
+  tpool_run(tp, (D->cols_al + w - 1) / w, precode_matrix_apply_stripe, &ps);
+  precode_matrix_permute(D, S);
 }
@@ -5,10 +5,26 @@
 #include "rand.h"
 #include "sched.h"
 #include "spmat.h"
+#include "tpool.h"
 #include "wrkmat.h"
 
-spmat *precode_matrix_gen(params *P, int overhead);
-schedule *precode_matrix_invert(params *P, spmat *A);
-void precode_matrix_intermediate(params *P, octmat *D, schedule *S);
+typedef enum {
+  PRECODE_FAST,    /* inactivate once no row has one or two ones left */
+  PRECODE_RFC6330, /* RFC 6330 5.4.2.2 row selection */
+} precode_strategy;
+
+// returns the precode matrix of isi 0..K'-1, which depends on K' alone
+spmat *precode_matrix_base(params *P);
+// returns the H x (K' + S) HDPC rows, which depend on K' alone
+octmat *precode_matrix_HDPC(params *P);
+// returns the precode matrix with LT rows for the K' + overhead symbols
+// isi[0..K' + overhead), or for isi 0, 1, ... if isi is NULL. inverting it
+// draws every temporary and the schedule from mem as well
+spmat *precode_matrix_gen(params *P, const uint32_t *isi, int overhead,
+                          arena *mem);
+schedule *precode_matrix_invert(params *P, spmat *A,
+                                precode_strategy strategy);
+void precode_matrix_intermediate(params *P, octmat *D, schedule *S,
+                                 tpool *tp);
 
 #endif
@@ -188,3 +188,11 @@ uint32_t rnd_get(const uint32_t y, const uint8_t i, const uint32_t m) {
 
   return (V0[x0] ^ V1[x1] ^ V2[x2] ^ V3[x3]) % m;
 }
+
+void rnd_get_batch(const uint32_t *y, uint8_t i, size_t n, uint32_t *dst) {
+  for (size_t k = 0; k < n; k++) {
+    const uint32_t v = y[k];
+    dst[k] = V0[(v + i) & 0xff] ^ V1[((v >> 8) + i) & 0xff] ^
+             V2[((v >> 16) + i) & 0xff] ^ V3[((v >> 24) + i) & 0xff];
+  }
+}
@@ -1,8 +1,11 @@
 #ifndef NANORQ_RAND_H
 #define NANORQ_RAND_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 uint32_t rnd_get(const uint32_t y, const uint8_t i, const uint32_t m);
+// rnd_get of y[0..n) before the reduction modulo m, which is left to the caller
+void rnd_get_batch(const uint32_t *y, uint8_t i, size_t n, uint32_t *dst);
 
 #endif
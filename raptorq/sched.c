@@ -1,14 +1,20 @@
+#include "oblas.h"
 #include "sched.h"
 
-schedule *sched_new(unsigned rows, unsigned cols, unsigned estimated_ops) {
-  schedule *S = calloc(1, sizeof(schedule));
+// how far ahead sched_compile looks for more ops on the same destination
+#define SCHED_WINDOW 64
+
+schedule *sched_new(unsigned rows, unsigned cols, unsigned estimated_ops,
+                    arena *mem) {
+  schedule *S = arena_calloc(mem, 1, sizeof(schedule));
+  S->mem = mem;
   S->rows = rows;
   S->cols = cols;
-  S->c = calloc(cols, sizeof(int));
-  S->ci = calloc(cols, sizeof(int));
-  S->d = calloc(rows, sizeof(int));
-  S->di = calloc(rows, sizeof(int));
-  S->nz = calloc(rows, sizeof(unsigned));
+  S->c = arena_alloc(mem, cols * sizeof(int));
+  S->ci = arena_alloc(mem, cols * sizeof(int));
+  S->d = arena_alloc(mem, rows * sizeof(int));
+  S->di = arena_alloc(mem, rows * sizeof(int));
+  S->nz = arena_calloc(mem, rows, sizeof(unsigned));
   // init permutation vectors
   for (int j = 0; j < cols; j++) {
     S->c[j] = j;
@@ -20,7 +26,8 @@ schedule *sched_new(unsigned rows, unsigned cols, unsigned estimated_ops) {
   }
 
   kv_init(S->ops);
-  kv_resize(sched_op, S->ops, estimated_ops);
+  S->ops.m = estimated_ops;
+  S->ops.a = arena_alloc(mem, estimated_ops * sizeof(sched_op));
 
   return S;
 }
@@ -28,22 +35,209 @@ schedule *sched_new(unsigned rows, unsigned cols, unsigned estimated_ops) {
 void sched_free(schedule *S) {
   if (!S)
     return;
-  if (S->c)
-    free(S->c);
-  if (S->d)
-    free(S->d);
-  if (S->ci)
-    free(S->ci);
-  if (S->di)
-    free(S->di);
-  if (S->nz)
-    free(S->nz);
-  if (kv_max(S->ops))
-    kv_destroy(S->ops);
-  free(S);
+  arena *mem = S->mem;
+  arena_release(mem, S->c);
+  arena_release(mem, S->d);
+  arena_release(mem, S->ci);
+  arena_release(mem, S->di);
+  arena_release(mem, S->nz);
+  arena_release(mem, S->ops.a);
+  arena_release(mem, S->prog.code);
+  arena_release(mem, S);
 }
 
 void sched_push(schedule *S, unsigned i, unsigned j, uint8_t beta) {
   sched_op op = {.i = i, .j = j, .beta = beta};
-  kv_push(sched_op, S->ops, op);
+  arena_kv_push(S->mem, sched_op, S->ops, op);
+}
+
+// the op order precode replay used to get from the marks, as one list
+static sched_op *sched_linearize(schedule *S, unsigned *n) {
+  int size = kv_size(S->ops), m0 = (int)S->marks[0], m1 = (int)S->marks[1];
+  sched_op *lin = arena_alloc(S->mem, (2 * size + 1) * sizeof(sched_op));
+  unsigned at = 0;
+  for (int i = 0; i < m1; i++)
+    lin[at++] = kv_A(S->ops, i);
+  for (int i = m0; i >= 0; i--)
+    lin[at++] = kv_A(S->ops, i);
+  for (int i = m1; i < size; i++)
+    lin[at++] = kv_A(S->ops, i);
+  for (int i = 0; i <= m0; i++)
+    lin[at++] = kv_A(S->ops, i);
+  *n = at;
+  return lin;
+}
+
+/* greedy pass: every op starts a group on its destination and pulls in the
+ * later ops on that destination that can move up to it, which is when no op
+ * in between writes their source or touches the destination. no-op scalings
+ * are dropped and sources repeated within a group are folded */
+void sched_compile(schedule *S, bool fuse) {
+  unsigned n, groups = 0, stamp = 0;
+  sched_op *lin = sched_linearize(S, &n);
+  unsigned window = fuse ? SCHED_WINDOW : 1;
+  uint8_t *taken = arena_calloc(S->mem, n + 1, 1);
+  unsigned *written = arena_calloc(S->mem, S->rows, sizeof(unsigned));
+  unsigned *slot = arena_calloc(S->mem, S->rows, sizeof(unsigned));
+  unsigned *slot_group = arena_calloc(S->mem, S->rows, sizeof(unsigned));
+  // every op adds at most a group head and one source, so code never grows
+  kvec_t(uint32_t) code = {0, 3 * n + 1, NULL};
+  code.a = arena_alloc(S->mem, code.m * sizeof(uint32_t));
+
+  for (unsigned i = 0; i < n; i++) {
+    if (taken[i])
+      continue;
+    sched_op op = lin[i];
+    taken[i] = 1;
+    if (op.beta == 0 && op.j < 2)
+      continue;
+
+    unsigned g = ++stamp, head = kv_size(code);
+    uint32_t dst = op.i;
+    uint8_t scale = 1;
+    kv_push(uint32_t, code, dst);
+    kv_push(uint32_t, code, 0);
+    for (unsigned j = i; j < n && j < i + window; j++) {
+      if (taken[j] && j != i)
+        continue;
+      sched_op o = lin[j];
+      if (o.i == dst) {
+        if (o.beta == 0) {
+          if (o.j < 2) {
+            taken[j] = 1;
+            continue;
+          }
+          if (kv_size(code) > head + 2)
+            break;
+          scale = OCTET_MUL(scale, o.j);
+          taken[j] = 1;
+          continue;
+        }
+        if (written[o.j] == g)
+          break;
+        if (slot_group[o.j] == g) {
+          kv_A(code, slot[o.j]) ^= o.beta;
+        } else {
+          slot_group[o.j] = g;
+          slot[o.j] = kv_size(code);
+          kv_push(uint32_t, code, o.j << 8 | o.beta);
+        }
+        taken[j] = 1;
+        continue;
+      }
+      // o stays behind, later ops may only pass it if independent of it
+      if (o.beta && o.j == dst)
+        break;
+      written[o.i] = g;
+    }
+
+    // drop sources that cancelled out
+    unsigned keep = head + 2;
+    for (unsigned k = head + 2; k < kv_size(code); k++) {
+      if (kv_A(code, k) & 0xff)
+        kv_A(code, keep++) = kv_A(code, k);
+    }
+    kv_size(code) = keep;
+    if (keep == head + 2 && scale == 1) {
+      kv_size(code) = head;
+      continue;
+    }
+    kv_A(code, head + 1) = (keep - head - 2) << 8 | scale;
+    groups++;
+  }
+
+  S->prog.code = code.a;
+  S->prog.len = kv_size(code);
+  S->prog.groups = groups;
+  S->prog.raw = n;
+  arena_release(S->mem, S->ops.a);
+  kv_init(S->ops);
+  arena_release(S->mem, lin);
+  arena_release(S->mem, taken);
+  arena_release(S->mem, written);
+  arena_release(S->mem, slot);
+  arena_release(S->mem, slot_group);
+}
+
+unsigned sched_prog_ops(schedule *S) {
+  unsigned ops = 0;
+  for (uint32_t at = 0; at < S->prog.len; at += 2 + (S->prog.code[at + 1] >> 8))
+    ops += (S->prog.code[at + 1] >> 8) + ((S->prog.code[at + 1] & 0xff) != 1);
+  return ops;
+}
+
+static bool write_u32(FILE *fp, uint32_t v) {
+  return fwrite(&v, sizeof(v), 1, fp) == 1;
+}
+
+static bool read_u32(FILE *fp, uint32_t *v) {
+  return fread(v, sizeof(*v), 1, fp) == 1;
+}
+
+static bool write_ints(FILE *fp, int *v, unsigned n) {
+  for (unsigned it = 0; it < n; it++)
+    if (!write_u32(fp, v[it]))
+      return false;
+  return true;
+}
+
+static bool read_ints(FILE *fp, int *v, unsigned n, unsigned max) {
+  uint32_t tmp;
+  for (unsigned it = 0; it < n; it++) {
+    if (!read_u32(fp, &tmp) || tmp >= max)
+      return false;
+    v[it] = tmp;
+  }
+  return true;
+}
+
+// only the fields needed to replay a compiled schedule are stored
+bool sched_write(schedule *S, FILE *fp) {
+  bool ok = write_u32(fp, S->rows) && write_u32(fp, S->cols) &&
+            write_u32(fp, S->i) && write_u32(fp, S->u) &&
+            write_u32(fp, S->prog.raw) && write_u32(fp, S->prog.groups) &&
+            write_u32(fp, S->prog.len);
+  ok = ok && write_ints(fp, S->c, S->cols) && write_ints(fp, S->ci, S->cols);
+  ok = ok && write_ints(fp, S->d, S->rows) && write_ints(fp, S->di, S->rows);
+  for (uint32_t at = 0; ok && at < S->prog.len; at++)
+    ok = write_u32(fp, S->prog.code[at]);
+  return ok;
+}
+
+schedule *sched_read(FILE *fp) {
+  uint32_t rows, cols, hdr[5];
+  if (!read_u32(fp, &rows) || !read_u32(fp, &cols) || rows == 0 ||
+      cols == 0 || rows > (1 << 20) || cols > rows)
+    return NULL;
+  for (int it = 0; it < 5; it++)
+    if (!read_u32(fp, &hdr[it]))
+      return NULL;
+  if (hdr[4] > (1 << 28))
+    return NULL;
+
+  schedule *S = sched_new(rows, cols, 0, NULL);
+  sched_prog *pg = &S->prog;
+  S->i = hdr[0];
+  S->u = hdr[1];
+  pg->raw = hdr[2];
+  pg->len = hdr[4];
+  pg->code = malloc((pg->len + 1) * sizeof(uint32_t));
+
+  bool ok = read_ints(fp, S->c, cols, cols) && read_ints(fp, S->ci, cols, cols);
+  ok = ok && read_ints(fp, S->d, rows, rows) && read_ints(fp, S->di, rows, rows);
+  for (uint32_t at = 0; ok && at < pg->len; at++)
+    ok = read_u32(fp, &pg->code[at]);
+  // every group must stay within the code and address rows of D
+  for (uint32_t at = 0; ok && at < pg->len; pg->groups++) {
+    uint32_t n = at + 1 < pg->len ? pg->code[at + 1] >> 8 : 0;
+    ok = at + 2 + n <= pg->len && pg->code[at] < rows;
+    for (uint32_t k = at + 2; ok && k < at + 2 + n; k++)
+      ok = (pg->code[k] >> 8) < rows;
+    at += 2 + n;
+  }
+  if (!ok || pg->groups != hdr[3]) {
+    sched_free(S);
+    return NULL;
+  }
+  return S;
 }
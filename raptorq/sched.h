@@ -1,6 +1,10 @@
 #ifndef NANORQ_SCHED_H
 #define NANORQ_SCHED_H
 
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "arena.h"
 #include "util.h"
 
 typedef struct {
@@ -11,6 +15,17 @@ typedef struct {
 
 typedef kvec_t(sched_op) oplist;
 
+/* compiled op list, one group per destination row visit
+ *   row dst = scale * row dst + sum of beta[k] * row src[k]
+ * packed into 32 bit words as dst, n << 8 | scale, then n times
+ * src[k] << 8 | beta[k] */
+typedef struct {
+  uint32_t *code;
+  uint32_t len;
+  uint32_t groups;
+  uint32_t raw; /* ops before compilation */
+} sched_prog;
+
 typedef struct {
   unsigned rows;
   unsigned cols;
@@ -19,15 +34,28 @@ typedef struct {
   int *ci; /* inverse map of c */
   int *di; /* inverse map of d */
   unsigned *nz;
-  oplist ops; /* list of decoding operations */
+  oplist ops; /* list of decoding operations, empty once compiled */
+  sched_prog prog;
   unsigned i; /* dim of X submatrix */
   unsigned u; /* remaining cols */
 
   unsigned marks[2]; /* checkpoints */
+  arena *mem;        /* everything above comes from it, NULL for the heap */
 } schedule;
 
-schedule *sched_new(unsigned rows, unsigned cols, unsigned estimated_ops);
+schedule *sched_new(unsigned rows, unsigned cols, unsigned estimated_ops,
+                    arena *mem);
 void sched_free(schedule *S);
 void sched_push(schedule *S, unsigned i, unsigned j, uint8_t beta);
 
+// replace the op list by its compiled form, fusing ops on the same
+// destination when the schedule gets replayed often enough to pay for it
+void sched_compile(schedule *S, bool fuse);
+
+// returns the number of row ops the compiled schedule performs
+unsigned sched_prog_ops(schedule *S);
+
+bool sched_write(schedule *S, FILE *fp);
+schedule *sched_read(FILE *fp);
+
 #endif
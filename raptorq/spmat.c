@@ -3,56 +3,66 @@
 
 #include "spmat.h"
 
-spmat *spmat_new(unsigned rows, unsigned cols) {
-  spmat *s = calloc(1, sizeof(spmat));
+spmat *spmat_new(unsigned rows, unsigned cols, arena *mem) {
+  spmat *s = arena_calloc(mem, 1, sizeof(spmat));
+  s->mem = mem;
   s->rows = rows;
   s->cols = cols;
-
-  s->idxs = calloc(sizeof(uint_vec), rows);
-
-  for (unsigned i = 0; i < rows; i++) {
-    kv_init(s->idxs[i]);
-    kv_resize(unsigned, s->idxs[i], 10);
-  }
-
+  s->ptr = arena_calloc(mem, rows + 1, sizeof(unsigned));
   return s;
 }
 
 void spmat_free(spmat *s) {
   if (!s)
     return;
-  if (s->idxs) {
-    for (unsigned i = 0; i < s->rows; i++)
-      kv_destroy(s->idxs[i]);
-    free(s->idxs);
-  }
-  free(s);
+  arena_release(s->mem, s->ptr);
+  arena_release(s->mem, s->idx);
+  arena_release(s->mem, s);
 }
 
-void spmat_clear_row(spmat *s, unsigned i) { kv_size(s->idxs[i]) = 0; }
+// ptr[i + 1] turns from the count of row i into its start, and is bumped past
+// every entry filled in so it ends up at the end of row i
+void spmat_alloc(spmat *s) {
+  unsigned at = 0;
+  for (unsigned i = 0; i < s->rows; i++) {
+    unsigned n = s->ptr[i + 1];
+    s->ptr[i + 1] = at;
+    at += n;
+  }
+  s->idx = arena_alloc(s->mem, (at ? at : 1) * sizeof(unsigned));
+}
 
 void spmat_push(spmat *s, unsigned i, unsigned j) {
-  kv_push(unsigned, s->idxs[i], j);
+  if (s->idx)
+    s->idx[s->ptr[i + 1]++] = j;
+  else
+    s->ptr[i + 1]++;
+}
+
+unsigned *spmat_reserve(spmat *s, unsigned i, unsigned n) {
+  unsigned at = s->ptr[i + 1];
+  s->ptr[i + 1] += n;
+  return s->idx ? s->idx + at : NULL;
 }
 
 spmat *spmat_transpose(spmat *s) {
-  spmat *t = spmat_new(s->cols, s->rows);
+  spmat *t = spmat_new(s->cols, s->rows, s->mem);
+  unsigned nnz = s->ptr[s->rows];
+  for (unsigned it = 0; it < nnz; it++)
+    t->ptr[s->idx[it] + 1]++;
+  spmat_alloc(t);
   for (unsigned i = 0; i < s->rows; i++) {
-    for (unsigned it = 0; it < kv_size(s->idxs[i]); it++) {
-      spmat_push(t, kv_A(s->idxs[i], it), i);
-    }
+    for (unsigned it = s->ptr[i]; it < s->ptr[i + 1]; it++)
+      t->idx[t->ptr[s->idx[it] + 1]++] = i;
   }
   return t;
 }
 
 unsigned spmat_nnz(spmat *s, unsigned row, unsigned start, unsigned end) {
-  unsigned nz = 0;
-  uint_vec rs = s->idxs[row];
-  for (unsigned it = 0; it < kv_size(rs); it++) {
-    unsigned col = kv_A(rs, it);
-    if (col >= start && col < end) {
+  unsigned nz = 0, *rs = spmat_row(s, row);
+  for (unsigned it = 0; it < spmat_row_len(s, row); it++) {
+    if (rs[it] >= start && rs[it] < end)
       nz++;
-    }
   }
   return nz;
 }
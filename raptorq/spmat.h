@@ -4,19 +4,36 @@
 #include <stdint.h>
 #include <stdio.h>
 
+#include "arena.h"
 #include "util.h"
 
+/* compressed rows, row i holds the columns idx[ptr[i]] up to idx[ptr[i + 1]]
+ *
+ * built in two passes over the same spmat_push / spmat_reserve calls, the
+ * first only counts the entries of every row, spmat_alloc then sizes idx and
+ * the second pass fills it in */
 typedef struct {
   unsigned rows;
   unsigned cols;
-  uint_vec *idxs;
+  unsigned *ptr;
+  unsigned *idx;
+  arena *mem; /* ptr and idx come from it, NULL for the heap */
 } spmat;
 
-spmat *spmat_new(unsigned rows, unsigned cols);
+#define spmat_row(s, i) ((s)->idx + (s)->ptr[i])
+#define spmat_row_len(s, i) ((s)->ptr[(i) + 1] - (s)->ptr[i])
+
+// returns an empty matrix in its counting pass
+spmat *spmat_new(unsigned rows, unsigned cols, arena *mem);
 void spmat_free(spmat *s);
 
-void spmat_clear_row(spmat *s, unsigned i);
+// ends the counting pass
+void spmat_alloc(spmat *s);
+
 void spmat_push(spmat *s, unsigned i, unsigned j);
+// room for the next n entries of row i, NULL in the counting pass
+unsigned *spmat_reserve(spmat *s, unsigned i, unsigned n);
+// the transpose shares the arena of s
 spmat *spmat_transpose(spmat *s);
 unsigned spmat_nnz(spmat *s, unsigned row, unsigned start, unsigned end);
 
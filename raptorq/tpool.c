@@ -0,0 +1,168 @@
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "tpool.h"
+
+struct tpool_batch {
+  tpool *tp;
+  tpool_fn fn;
+  void *arg;
+  unsigned n;
+  unsigned next; /* next unclaimed item */
+  unsigned done; /* finished items */
+  tpool_batch *link;
+};
+
+struct tpool {
+  pthread_mutex_t lock;
+  pthread_cond_t work;
+  pthread_cond_t done;
+  tpool_batch *head, *tail;
+  unsigned nthreads;
+  bool stop;
+  pthread_t *threads;
+};
+
+static void tpool_dequeue(tpool *tp, tpool_batch *b) {
+  tpool_batch **at = &tp->head, *prev = NULL;
+  while (*at && *at != b) {
+    prev = *at;
+    at = &(*at)->link;
+  }
+  if (*at == NULL)
+    return;
+  *at = b->link;
+  if (tp->tail == b)
+    tp->tail = prev;
+  b->link = NULL;
+}
+
+/* claim one item of b, called with the pool lock held */
+static bool tpool_claim(tpool_batch *b, unsigned *idx) {
+  if (b->next >= b->n)
+    return false;
+  *idx = b->next++;
+  if (b->next == b->n && b->tp)
+    tpool_dequeue(b->tp, b);
+  return true;
+}
+
+static void *tpool_worker(void *arg) {
+  tpool *tp = (tpool *)arg;
+  pthread_mutex_lock(&tp->lock);
+  for (;;) {
+    while (!tp->stop && tp->head == NULL)
+      pthread_cond_wait(&tp->work, &tp->lock);
+    if (tp->stop)
+      break;
+    unsigned idx;
+    tpool_batch *b = tp->head;
+    if (!tpool_claim(b, &idx))
+      continue;
+    pthread_mutex_unlock(&tp->lock);
+    b->fn(b->arg, idx);
+    pthread_mutex_lock(&tp->lock);
+    if (++b->done == b->n)
+      pthread_cond_broadcast(&tp->done);
+  }
+  pthread_mutex_unlock(&tp->lock);
+  return NULL;
+}
+
+tpool *tpool_new(unsigned nthreads) {
+  if (nthreads == 0)
+    return NULL;
+
+  tpool *tp = calloc(1, sizeof(tpool));
+  pthread_mutex_init(&tp->lock, NULL);
+  pthread_cond_init(&tp->work, NULL);
+  pthread_cond_init(&tp->done, NULL);
+  tp->threads = calloc(nthreads, sizeof(pthread_t));
+  for (unsigned t = 0; t < nthreads; t++) {
+    if (pthread_create(&tp->threads[t], NULL, tpool_worker, tp) != 0)
+      break;
+    tp->nthreads++;
+  }
+  if (tp->nthreads == 0) {
+    tpool_free(tp);
+    return NULL;
+  }
+  return tp;
+}
+
+void tpool_free(tpool *tp) {
+  if (!tp)
+    return;
+  pthread_mutex_lock(&tp->lock);
+  tp->stop = true;
+  pthread_cond_broadcast(&tp->work);
+  pthread_mutex_unlock(&tp->lock);
+  for (unsigned t = 0; t < tp->nthreads; t++)
+    pthread_join(tp->threads[t], NULL);
+  pthread_cond_destroy(&tp->done);
+  pthread_cond_destroy(&tp->work);
+  pthread_mutex_destroy(&tp->lock);
+  free(tp->threads);
+  free(tp);
+}
+
+unsigned tpool_threads(tpool *tp) { return tp ? tp->nthreads : 0; }
+
+static void tpool_enqueue(tpool_batch *b, tpool *tp, unsigned n, tpool_fn fn,
+                          void *arg) {
+  b->tp = tp;
+  b->fn = fn;
+  b->arg = arg;
+  b->n = n;
+  if (!tp || n == 0)
+    return;
+
+  pthread_mutex_lock(&tp->lock);
+  if (tp->tail)
+    tp->tail->link = b;
+  else
+    tp->head = b;
+  tp->tail = b;
+  pthread_cond_broadcast(&tp->work);
+  pthread_mutex_unlock(&tp->lock);
+}
+
+static void tpool_finish(tpool_batch *b) {
+  tpool *tp = b->tp;
+  unsigned idx;
+
+  if (!tp) {
+    while (tpool_claim(b, &idx))
+      b->fn(b->arg, idx);
+    return;
+  }
+
+  pthread_mutex_lock(&tp->lock);
+  while (tpool_claim(b, &idx)) {
+    pthread_mutex_unlock(&tp->lock);
+    b->fn(b->arg, idx);
+    pthread_mutex_lock(&tp->lock);
+    b->done++;
+  }
+  while (b->done < b->n)
+    pthread_cond_wait(&tp->done, &tp->lock);
+  pthread_mutex_unlock(&tp->lock);
+}
+
+tpool_batch *tpool_submit(tpool *tp, unsigned n, tpool_fn fn, void *arg) {
+  tpool_batch *b = calloc(1, sizeof(tpool_batch));
+  tpool_enqueue(b, tp, n, fn, arg);
+  return b;
+}
+
+void tpool_wait(tpool_batch *b) {
+  tpool_finish(b);
+  free(b);
+}
+
+// the caller waits anyway, so the batch lives on its stack
+void tpool_run(tpool *tp, unsigned n, tpool_fn fn, void *arg) {
+  tpool_batch b = {0};
+  tpool_enqueue(&b, tp, n, fn, arg);
+  tpool_finish(&b);
+}
@@ -0,0 +1,27 @@
+#ifndef NANORQ_TPOOL_H
+#define NANORQ_TPOOL_H
+
+#include <stdbool.h>
+
+typedef void (*tpool_fn)(void *arg, unsigned idx);
+
+typedef struct tpool tpool;
+typedef struct tpool_batch tpool_batch;
+
+// returns a pool with nthreads workers, or NULL when nthreads is 0
+tpool *tpool_new(unsigned nthreads);
+void tpool_free(tpool *tp);
+
+// returns the number of workers, 0 for a NULL pool
+unsigned tpool_threads(tpool *tp);
+
+// queue fn(arg, 0..n-1) on the pool, a NULL pool defers all work to wait
+tpool_batch *tpool_submit(tpool *tp, unsigned n, tpool_fn fn, void *arg);
+
+// run the unclaimed items of a batch on the caller, wait for the rest
+void tpool_wait(tpool_batch *b);
+
+// submit and wait
+void tpool_run(tpool *tp, unsigned n, tpool_fn fn, void *arg);
+
+#endif
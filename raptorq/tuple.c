@@ -1,43 +1,97 @@
 #include "tuple.h"
 #include "rand.h"
 
-static const uint32_t degree_dist[] = {
+// padded to 32 entries for the search in degrees
+static const uint32_t degree_dist[32] = {
     0,       5243,    529531,  704294,  791675,  844104,  879057,  904023,
     922747,  937311,  948962,  958494,  966438,  973160,  978921,  983914,
     988283,  992138,  995565,  998631,  1001391, 1003887, 1006157, 1008229,
-    1010129, 1011876, 1013490, 1014983, 1016370, 1017662, 1048576};
+    1010129, 1011876, 1013490, 1014983, 1016370, 1017662, 1048576, UINT32_MAX};
 
-static const uint16_t degree_dist_size =
-    sizeof(degree_dist) / sizeof(degree_dist[0]);
+// the degree of each v is the count of entries of degree_dist at or below it,
+// found by a binary search without branches
+static void degrees(const uint32_t *v, size_t n, uint16_t W, tuple *dst) {
+  for (size_t k = 0; k < n; k++) {
+    uint32_t x = v[k] & ((1 << 20) - 1), d = 0;
+    d += (degree_dist[d + 15] <= x) << 4;
+    d += (degree_dist[d + 7] <= x) << 3;
+    d += (degree_dist[d + 3] <= x) << 2;
+    d += (degree_dist[d + 1] <= x) << 1;
+    d += (degree_dist[d] <= x);
+    dst[k].d = (d < W - 2u) ? d : W - 2u;
+  }
+}
+
+void gen_tuples(params *P, const uint32_t *isi, uint32_t first, size_t n,
+                tuple *dst) {
+  uint32_t X[TUPLE_BATCH], y[TUPLE_BATCH], r[TUPLE_BATCH];
+  // wraps modulo 2^32 like the reference's 32 bit arithmetic
+  uint32_t A = (53591 + P->J * 997) | 1;
+  uint32_t B1 = 10267 * (P->J + 1);
 
-static uint16_t deg(uint32_t v, uint16_t W) {
-  for (int d = 0; d < degree_dist_size; d++) {
-    if (v < degree_dist[d])
-      return (d < (W - 2)) ? d : (W - 2);
+  for (size_t at = 0; at < n; at += TUPLE_BATCH, dst += TUPLE_BATCH) {
+    size_t m = (n - at < TUPLE_BATCH) ? n - at : TUPLE_BATCH;
+    for (size_t k = 0; k < m; k++) {
+      X[k] = isi ? isi[at + k] : first + (uint32_t)(at + k);
+      y[k] = B1 + X[k] * A;
+    }
+    rnd_get_batch(y, 0, m, r);
+    degrees(r, m, P->W, dst);
+    rnd_get_batch(y, 1, m, r);
+    for (size_t k = 0; k < m; k++)
+      dst[k].a = 1 + params_mod(r[k], P->divW1);
+    rnd_get_batch(y, 2, m, r);
+    for (size_t k = 0; k < m; k++)
+      dst[k].b = params_mod(r[k], P->divW);
+    rnd_get_batch(X, 3, m, r);
+    for (size_t k = 0; k < m; k++)
+      dst[k].d1 = 2 + ((dst[k].d < 4) & r[k]);
+    rnd_get_batch(X, 4, m, r);
+    for (size_t k = 0; k < m; k++)
+      dst[k].a1 = 1 + params_mod(r[k], P->divP11);
+    rnd_get_batch(X, 5, m, r);
+    for (size_t k = 0; k < m; k++)
+      dst[k].b1 = params_mod(r[k], P->divP1);
   }
-  return 0;
 }
 
+// gen_tuples for a single isi, without the batch loops around it
 tuple gen_tuple(uint32_t X, params *P) {
   tuple ret;
+  uint32_t y = 10267 * (P->J + 1) + X * ((53591 + P->J * 997) | 1), r;
 
-  size_t A = 53591 + P->J * 997;
-
-  if (A % 2 == 0)
-    A++;
-  size_t B1 = 10267 * (P->J + 1);
-  uint32_t y = (uint32_t)((B1 + X * A));
-  uint32_t v = rnd_get(y, 0, (uint32_t)((1 << 20)));
-  ret.d = deg(v, P->W);
-  ret.a = 1 + rnd_get(y, 1, P->W - 1);
-  ret.b = rnd_get(y, 2, P->W);
-  if (ret.d < 4) {
-    ret.d1 = 2 + rnd_get(X, 3, 2);
-  } else {
-    ret.d1 = 2;
+  rnd_get_batch(&y, 0, 1, &r);
+  degrees(&r, 1, P->W, &ret);
+  rnd_get_batch(&y, 1, 1, &r);
+  ret.a = 1 + params_mod(r, P->divW1);
+  rnd_get_batch(&y, 2, 1, &r);
+  ret.b = params_mod(r, P->divW);
+  rnd_get_batch(&X, 3, 1, &r);
+  ret.d1 = 2 + ((ret.d < 4) & r);
+  rnd_get_batch(&X, 4, 1, &r);
+  ret.a1 = 1 + params_mod(r, P->divP11);
+  rnd_get_batch(&X, 5, 1, &r);
+  ret.b1 = params_mod(r, P->divP1);
+  return ret;
+}
+
+// a < W and a1 < P1, so each step wraps at most once
+#define tuple_step(b, a, m) ((b) + (a) >= (m) ? (b) + (a) - (m) : (b) + (a))
+
+void tuple_idxs(tuple t, params *P, unsigned *dst) {
+  *dst++ = t.b;
+  for (unsigned j = 1; j < t.d; j++) {
+    t.b = tuple_step(t.b, t.a, P->W);
+    *dst++ = t.b;
   }
-  ret.a1 = 1 + rnd_get(X, 4, P->P1 - 1);
-  ret.b1 = rnd_get(X, 5, P->P1);
+  while (t.b1 >= P->P)
+    t.b1 = tuple_step(t.b1, t.a1, P->P1);
 
-  return ret;
+  *dst++ = P->W + t.b1;
+  for (unsigned j = 1; j < t.d1; j++) {
+    t.b1 = tuple_step(t.b1, t.a1, P->P1);
+    while (t.b1 >= P->P)
+      t.b1 = tuple_step(t.b1, t.a1, P->P1);
+    *dst++ = P->W + t.b1;
+  }
 }
@@ -12,6 +12,15 @@ typedef struct {
   uint32_t b1;
 } tuple;
 
+#define tuple_len(t) ((t).d + (t).d1)
+// tuples gen_tuples derives per pass over its lookup tables
+#define TUPLE_BATCH 64
+
 tuple gen_tuple(uint32_t X, params *P);
+// the tuples of isi[0..n), or of first..first + n when isi is NULL
+void gen_tuples(params *P, const uint32_t *isi, uint32_t first, size_t n,
+                tuple *dst);
+// writes the tuple_len(t) columns of the LT row of t to dst
+void tuple_idxs(tuple t, params *P, unsigned *dst);
 
 #endif
@@ -19,12 +19,6 @@
     b = __tmp;                                                                 \
   } while (0)
 
-typedef struct {
-  uint32_t esi;
-  octmat row;
-} repair_sym;
-
-typedef kvec_t(repair_sym) repair_vec;
 typedef kvec_t(unsigned) uint_vec;
 
 #endif
@@ -4,14 +4,15 @@
 #include "gf2.h"
 #include "wrkmat.h"
 
-wrkmat *wrkmat_new(int rows, int cols) {
-  wrkmat *w = calloc(1, sizeof(wrkmat));
+wrkmat *wrkmat_new(int rows, int cols, arena *mem) {
+  wrkmat *w = arena_calloc(mem, 1, sizeof(wrkmat));
+  w->mem = mem;
   w->rows = rows;
   w->cols = cols;
 
-  w->GF2 = gf2mat_new(rows, cols);
-  w->rowmap = calloc(sizeof(int), rows);
-  w->type = calloc(sizeof(int), rows);
+  w->GF2 = arena_gf2mat(mem, rows, cols);
+  w->rowmap = arena_calloc(mem, rows, sizeof(int));
+  w->type = arena_calloc(mem, rows, sizeof(int));
 
   return w;
 }
@@ -19,14 +20,12 @@ wrkmat *wrkmat_new(int rows, int cols) {
 void wrkmat_free(wrkmat *w) {
   if (!w)
     return;
-  if (w->rowmap)
-    free(w->rowmap);
-  if (w->type)
-    free(w->type);
+  arena_release(w->mem, w->rowmap);
+  arena_release(w->mem, w->type);
   if (w->GF2)
-    gf2mat_free(w->GF2);
-  om_destroy(&w->GF256);
-  free(w);
+    arena_gf2mat_release(w->mem, w->GF2);
+  arena_octmat_release(w->mem, &w->GF256);
+  arena_release(w->mem, w);
 }
 
 void wrkmat_assign_block(wrkmat *w, octmat *B, int i, int j, int m, int n) {
@@ -87,7 +86,7 @@ void wrkmat_axpy(wrkmat *w, int i, int j, int beta) {
     if (w->type[i]) {
       // uint8_t *tmp = om_R(w->GF256, w->rowmap[i]);
       // gf2mat_axpy(w->GF2, j, tmp, beta);
-      uint32_t *tmp = w->GF2->bits + w->GF2->stride * j;
+      uint32_t *tmp = (uint32_t *)(w->GF2->bits + w->GF2->stride * j);
       oaxpy_b32(om_P(w->GF256), tmp, w->rowmap[i], w->cols, beta);
     } else {
       if (w->blkidx >= w->GF256.rows) {
@@ -4,6 +4,7 @@
 #include <stdint.h>
 #include <stdio.h>
 
+#include "arena.h"
 #include "gf2.h"
 #include "oblas.h"
 #include "octmat.h"
@@ -16,15 +17,19 @@ typedef struct {
   size_t blkidx;
   int *rowmap;
   int *type;
+  arena *mem; /* everything above comes from it, NULL for the heap */
 } wrkmat;
 
 #define gf2row(a, r) (a->bits + (r)*a->stride)
-#define gf2el(a, i, j) ((gf2row(a, i)[(j) / 32] >> ((j) % 32)) & 1)
+#define gf2el(a, i, j) ((gf2row(a, i)[(j) / gf2wsz] >> ((j) % gf2wsz)) & 1)
+// n <= 8 bits of row i from column j on, which must not cross a word
+#define gf2bits(a, i, j, n)                                                    \
+  ((unsigned)(gf2row(a, i)[(j) / gf2wsz] >> ((j) % gf2wsz)) & ((1U << (n)) - 1))
 
 #define wrkmat_at(w, i, j)                                                     \
   (w->type[i] ? om_A(w->GF256, w->rowmap[i], j) : gf2el(w->GF2, i, j))
 
-wrkmat *wrkmat_new(int rows, int cols);
+wrkmat *wrkmat_new(int rows, int cols, arena *mem);
 void wrkmat_free(wrkmat *w);
 void wrkmat_assign_block(wrkmat *w, octmat *B, int i, int j, int m, int n);
 void wrkmat_print(wrkmat *w, FILE *stream);
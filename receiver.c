@@ -25,6 +25,7 @@
 
 
 #include <nanorq.h>
+#include <oblas.h>
 
 #define MAX_ESI 65535
 
@@ -110,6 +111,33 @@ uint32_t parse_tag_oti_scheme(uint8_t *packet)
     return oti_scheme;
 }
 
+// counts sbn once the decoder holds all of its source symbols, whether they
+// arrived, were decoded on arrival or came out of a repair attempt
+void note_block(nanorq *rq, uint8_t sbn, uint64_t *decoded_blocks)
+{
+    if (block_decoded[sbn] || nanorq_num_missing(rq, sbn) > 0)
+        return;
+    fprintf(stdout, "\x1b[2K\rDECODE OF BLOCK %d SUCCESSFUL!", sbn);
+    block_decoded[sbn] = true;
+    (*decoded_blocks)++;
+}
+
+// completion events of the repair attempts queued with nanorq_repair_async
+void reap_repairs(nanorq *rq, struct ioctx *myio, uint64_t *decoded_blocks)
+{
+    bool repaired;
+    int sbn;
+    while ((sbn = nanorq_repair_reap(rq, myio, false, &repaired)) >= 0)
+    {
+        if (!repaired)
+        {
+            fprintf(stdout, "Decode of sbn %d failed. Continuing...\n", sbn);
+            continue;
+        }
+        note_block(rq, (uint8_t)sbn, decoded_blocks);
+    }
+}
+
 void print_usage(const char *prog_name)
 {
     printf("Usage: %s [options] file_to_receive modulation_mode\n", prog_name);
@@ -117,6 +145,10 @@ void print_usage(const char *prog_name)
     printf("  -t, --tcp         Use TCP input from hermes-modem (default: shared memory)\n");
     printf("  -i, --ip IP       IP address of hermes-modem (default: %s)\n", DEFAULT_MODEM_IP);
     printf("  -p, --port PORT   TCP port of hermes-modem (default: %d)\n", DEFAULT_MODEM_PORT);
+    printf("  -T, --threads N   Repair attempt threads (default: number of CPUs)\n");
+    printf("  -I, --incremental-max K\n");
+    printf("                    Largest K' decoded as symbols arrive, 0 inverts every\n");
+    printf("                    block once enough arrived (default: %d)\n", NANORQ_INC_MAX_KPRIME);
     printf("  -h, --help        Show this help message\n");
     printf("\nModulation modes:\n");
     printf("  Shared memory (Mercury): 0-16\n");
@@ -181,18 +213,22 @@ int main(int argc, char *argv[])
     input_mode_t in_mode = INPUT_SHM;
     char *tcp_ip = DEFAULT_MODEM_IP;
     int tcp_port = DEFAULT_MODEM_PORT;
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t incremental_max = NANORQ_INC_MAX_KPRIME;
 
     static struct option long_options[] = {
         {"tcp",  no_argument,       0, 't'},
         {"ip",   required_argument, 0, 'i'},
         {"port", required_argument, 0, 'p'},
+        {"threads", required_argument, 0, 'T'},
+        {"incremental-max", required_argument, 0, 'I'},
         {"help", no_argument,       0, 'h'},
         {0, 0, 0, 0}
     };
 
     int opt;
     int option_index = 0;
-    while ((opt = getopt_long(argc, argv, "ti:p:h", long_options, &option_index)) != -1)
+    while ((opt = getopt_long(argc, argv, "ti:p:T:I:h", long_options, &option_index)) != -1)
     {
         switch (opt)
         {
@@ -205,6 +241,12 @@ int main(int argc, char *argv[])
         case 'p':
             tcp_port = atoi(optarg);
             break;
+        case 'T':
+            threads = atoi(optarg);
+            break;
+        case 'I':
+            incremental_max = (uint32_t)strtoul(optarg, NULL, 10);
+            break;
         case 'h':
             print_usage(argv[0]);
             return 0;
@@ -243,7 +285,7 @@ int main(int argc, char *argv[])
 
     uint32_t frame_size = frame_sizes[mod_mode];
 
-    printf("Mode: %d, Frame size: %u bytes\n", mod_mode, frame_size);
+    printf("Mode: %d, Frame size: %u bytes, oblas: %s\n", mod_mode, frame_size, oblas_backend());
 
     running = true;
     signal(SIGQUIT, exit_system);
@@ -312,6 +354,16 @@ try_again:
         int read_result = read_frame_from_input(in_mode, buffer, data_frame, frame_size, &rx_frame_len);
         if (read_result == 0)
         {
+            // repair attempts keep running on the pool while no frame comes
+            if (rq)
+            {
+                reap_repairs(rq, myio, &decoded_blocks);
+                if (nanorq_decoder_progress(rq, 0, NULL, NULL, NULL) == 0)
+                {
+                    printf("\x1b[2K\rFILE SUCCESSFULLY RECEIVED!\n");
+                    goto success;
+                }
+            }
             usleep(100000); // 0.1s - shorter for TCP mode
             continue;
         }
@@ -352,6 +404,7 @@ try_again:
             }
 
             nanorq_set_max_esi(rq, MAX_ESI);
+            nanorq_set_incremental_max(rq, incremental_max);
 
             num_sbn = nanorq_blocks(rq);
 
@@ -404,6 +457,7 @@ try_again:
                 symbols_added++;
                 esi[sbn]++;
                 have_more_symbols = true;
+                note_block(rq, sbn, &decoded_blocks);
             }
             else if (ret == NANORQ_SYM_DUP)
             {
@@ -414,30 +468,13 @@ try_again:
             fprintf(stdout, "Blk: %3d  Recv: %3d of %3lu", sbn, esi[sbn], nanorq_block_symbols(rq, sbn));
             fflush(stdout);
 
-            // if (esi[sbn] >= nanorq_block_symbols(rq, sbn) && have_more_symbols)
+            // the attempt runs on the decoder's pool, frames keep being read
+            // meanwhile and reap_repairs() reports how it went
             if (esi[sbn] >= nanorq_block_symbols(rq, sbn) && have_more_symbols)
-            {
-                if (!nanorq_repair_block(rq, myio, sbn))
-                {
-                    fprintf(stdout, "Decode of sbn %d failed. Continuing...\n", sbn);
-                }
-                else
-                {
-                    fprintf(stdout, "\x1b[2K\rDECODE OF BLOCK %d SUCCESSFUL!", sbn);
-                    if (!block_decoded[sbn])
-                    {
-                        block_decoded[sbn] = true;
-                        decoded_blocks++;
-                    }
-                }
-            }
+                nanorq_repair_async(rq, sbn, (threads > 0) ? (unsigned)threads : 1);
+            reap_repairs(rq, myio, &decoded_blocks);
             // write_configuration_packets(buffer);
-            bool file_received = true;
-            for (int i = 0; i < num_sbn; i++)
-            {
-                if (block_decoded[i] == false)
-                    file_received = false;
-            }
+            bool file_received = (nanorq_decoder_progress(rq, 0, NULL, NULL, NULL) == 0);
 
             if (file_received == true)
             {
@@ -483,7 +520,11 @@ success:
     printf("shutdown.\n");
     printf("\e[?25h"); // re-enable cursor
     if (rq)
+    {
+        printf("RaptorQ peak symbol memory: %zu KiB\n", nanorq_peak_memory(rq) / 1024);
         nanorq_free(rq);
+        rq = NULL;
+    }
 
 //enable loop
 #ifdef ENABLE_LOOP
@@ -0,0 +1,23 @@
+#ifndef TESTS_CHECK_H
+#define TESTS_CHECK_H
+
+#include <stdio.h>
+
+static int check_failures = 0;
+
+// reports a failed condition and carries on with the test
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__,         \
+              #cond);                                                          \
+      check_failures++;                                                        \
+    }                                                                          \
+  } while (0)
+
+// exit status of a test, prints its verdict
+#define CHECK_DONE(name)                                                       \
+  (printf("%s: %s\n", (name), check_failures ? "FAIL" : "ok"),                 \
+   check_failures ? 1 : 0)
+
+#endif
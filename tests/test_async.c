@@ -0,0 +1,114 @@
+// background repair attempts: interleaved arrival across blocks with
+// attempts reaped as they finish, symbols held back while an attempt is in
+// flight, and decoders freed with attempts still running. "make check-tsan"
+// runs it under ThreadSanitizer
+#include "transfer.h"
+
+#define THREADS 2
+
+// blocks of about K symbols, all of them repaired rather than decoded on
+// arrival
+static void open_blocks(transfer *x, size_t K, uint16_t T, uint16_t Z,
+                        unsigned seed) {
+  transfer_open(x, K * Z * T - seed % T, T, Z, 0, THREADS, seed);
+}
+
+static void reaped(transfer *x, int sbn, bool repaired) {
+  CHECK(sbn >= 0 && (size_t)sbn < nanorq_blocks(x->dec));
+  CHECK(repaired == (nanorq_num_missing(x->dec, sbn) == 0));
+}
+
+// one symbol of every block per esi with random loss, as a carousel sends
+// them. a block gets an attempt whenever it holds K symbols and none is in
+// flight, finished attempts are reaped after every symbol
+static void interleaved(size_t K, uint16_t T, uint16_t Z, double loss,
+                        unsigned seed) {
+  transfer x;
+  open_blocks(&x, K, T, Z, seed);
+  size_t blocks = nanorq_blocks(x.dec);
+  size_t *got = calloc(blocks, sizeof(size_t));
+  bool repaired;
+  int sbn;
+  for (uint32_t esi = 0; esi < 65535; esi++) {
+    if (nanorq_decoder_progress(x.dec, 0, NULL, NULL, NULL) == 0)
+      break;
+    for (uint8_t b = 0; b < blocks; b++) {
+      if ((double)rand() / RAND_MAX < loss)
+        continue;
+      size_t Kb = nanorq_block_symbols(x.dec, b);
+      if (got[b] + 1 == Kb)
+        CHECK(!nanorq_repair_async(x.dec, b, THREADS));
+      if (transfer_add(&x, b, esi) == NANORQ_SYM_ADDED)
+        got[b]++;
+      if (got[b] >= Kb && nanorq_repair_async(x.dec, b, THREADS))
+        CHECK(!nanorq_repair_async(x.dec, b, THREADS));
+      while ((sbn = nanorq_repair_reap(x.dec, x.out, false, &repaired)) >= 0)
+        reaped(&x, sbn, repaired);
+    }
+  }
+  while ((sbn = nanorq_repair_reap(x.dec, x.out, true, &repaired)) >= 0)
+    reaped(&x, sbn, repaired);
+  CHECK(nanorq_repair_reap(x.dec, x.out, true, &repaired) == -1);
+  free(got);
+  transfer_close(&x, true);
+}
+
+// symbols added while the attempt runs are held back, duplicates of them are
+// reported as such, and reaping adds them to a block the attempt did not
+// complete. returns whether it did not
+static bool held(size_t K, uint16_t T, unsigned seed) {
+  transfer x;
+  open_blocks(&x, K, T, 1, seed);
+  // esi 0 is always lost, so the block needs repair symbols
+  uint32_t esi = 1;
+  for (size_t got = 0; got < K; esi++) {
+    if (rand() % 4 == 0)
+      continue;
+    CHECK(transfer_add(&x, 0, esi) == NANORQ_SYM_ADDED);
+    got++;
+  }
+  size_t repairs_before = nanorq_num_repair(x.dec, 0);
+  CHECK(nanorq_repair_async(x.dec, 0, THREADS));
+  for (int i = 0; i < 3; i++)
+    CHECK(transfer_add(&x, 0, esi + i) == NANORQ_SYM_ADDED);
+  CHECK(transfer_add(&x, 0, esi) == NANORQ_SYM_DUP);
+
+  bool repaired;
+  CHECK(nanorq_repair_reap(x.dec, x.out, true, &repaired) == 0);
+  if (!repaired) {
+    // the three held symbols went into the block, so it can be retried
+    CHECK(nanorq_num_repair(x.dec, 0) > repairs_before);
+    CHECK(nanorq_repair_block(x.dec, x.out, 0));
+  }
+  CHECK(nanorq_num_missing(x.dec, 0) == 0);
+  transfer_close(&x, true);
+  return !repaired;
+}
+
+// every block gets an attempt, then the decoder goes away without reaping
+static void free_in_flight(size_t K, uint16_t T, uint16_t Z, unsigned seed) {
+  transfer x;
+  open_blocks(&x, K, T, Z, seed);
+  for (uint8_t b = 0; b < nanorq_blocks(x.dec); b++) {
+    for (uint32_t esi = 0; esi < nanorq_block_symbols(x.dec, b); esi++)
+      transfer_add(&x, b, 2 * esi);
+    CHECK(nanorq_repair_async(x.dec, b, THREADS));
+  }
+  transfer_close(&x, false);
+}
+
+int main(void) {
+  interleaved(300, 64, 4, 0.05, 1);
+  interleaved(1000, 32, 3, 0.3, 2);
+  interleaved(1000, 32, 3, 0.6, 3);
+  for (unsigned s = 0; s < 4; s++)
+    held(500, 16, 10 + s);
+  // about 1 in 200 attempts without overhead fails, enough small blocks
+  // are tried to reach the held symbols of a failed one
+  size_t failed = 0;
+  for (unsigned s = 0; s < 2000 && failed < 3; s++)
+    failed += held(10, 16, 100 + s);
+  CHECK(failed > 0);
+  free_in_flight(1000, 64, 4, 20);
+  return CHECK_DONE("test_async");
+}
@@ -0,0 +1,96 @@
+// on-disk schedule cache: a saved schedule comes back bit exact and is used
+// instead of a new inversion, damaged files are rejected
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cache.h"
+#include "check.h"
+#include "nanorq.h"
+
+// the file format, changing any of it must bump CACHE_VERSION
+#define FILE_MAGIC 0x5351524e
+#define FILE_VERSION 2
+
+#define LEN 60000
+#define T 64
+#define REPAIRS 32
+
+// encodes REPAIRS repair symbols of a fresh encoder into out
+static void encode_repairs(const uint8_t *src, uint8_t *out) {
+  struct ioctx *io = ioctx_from_mem((void *)src, LEN);
+  nanorq *rq = nanorq_encoder_new_ex(LEN, T, 0, 1, 1);
+  size_t K = nanorq_block_symbols(rq, 0);
+  CHECK(nanorq_encode_batch(rq, 0, K, REPAIRS, out, T, io) == REPAIRS);
+  nanorq_free(rq);
+  io->destroy(io);
+}
+
+static void copy_file(const char *from, const char *to, long trim,
+                      long patch_at, const void *patch, size_t patch_len) {
+  FILE *in = fopen(from, "rb"), *out = fopen(to, "wb");
+  fseek(in, 0, SEEK_END);
+  long size = ftell(in) - trim;
+  rewind(in);
+  uint8_t *buf = malloc(size);
+  CHECK(fread(buf, 1, size, in) == (size_t)size);
+  if (patch)
+    memcpy(buf + patch_at, patch, patch_len);
+  fwrite(buf, 1, size, out);
+  free(buf);
+  fclose(in);
+  fclose(out);
+}
+
+int main(void) {
+  char path[] = "/tmp/nanorq-cache-XXXXXX";
+  char bad[sizeof(path) + 4];
+  int fd = mkstemp(path);
+  close(fd);
+  snprintf(bad, sizeof(bad), "%s.bad", path);
+
+  uint8_t *src = malloc(LEN), a[REPAIRS * T], b[REPAIRS * T];
+  srand(1);
+  for (size_t i = 0; i < LEN; i++)
+    src[i] = rand();
+
+  encode_repairs(src, a);
+  CHECK(cache_dirty());
+  CHECK(nanorq_cache_save(path));
+  CHECK(!cache_dirty());
+
+  uint32_t hdr[3] = {0};
+  FILE *fp = fopen(path, "rb");
+  CHECK(fread(hdr, sizeof(uint32_t), 3, fp) == 3);
+  fclose(fp);
+  CHECK(hdr[0] == FILE_MAGIC && hdr[1] == FILE_VERSION && hdr[2] == 1);
+
+  // nothing holds the schedule any more, drop it and read it back
+  nanorq_cache_limit(0);
+  nanorq_cache_limit(16 << 20);
+  CHECK(nanorq_cache_load(path));
+  encode_repairs(src, b);
+  CHECK(memcmp(a, b, sizeof(a)) == 0);
+  // no inversion ran, so there is nothing new to save
+  CHECK(!cache_dirty());
+
+  nanorq_cache_limit(0);
+  uint32_t word = FILE_MAGIC + 1;
+  copy_file(path, bad, 0, 0, &word, sizeof(word));
+  CHECK(!nanorq_cache_load(bad));
+  word = FILE_VERSION + 1;
+  copy_file(path, bad, 0, 4, &word, sizeof(word));
+  CHECK(!nanorq_cache_load(bad));
+  copy_file(path, bad, 4, 0, NULL, 0);
+  CHECK(!nanorq_cache_load(bad));
+  // 11 is no K' of the systematic index table
+  uint16_t Kprime = 11;
+  copy_file(path, bad, 0, 12, &Kprime, sizeof(Kprime));
+  CHECK(!nanorq_cache_load(bad));
+  CHECK(!nanorq_cache_load("/nonexistent/nanorq-cache"));
+
+  remove(bad);
+  remove(path);
+  free(src);
+  return CHECK_DONE("test_cache");
+}
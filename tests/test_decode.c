@@ -0,0 +1,64 @@
+// round trips through the on-arrival decoder and the batch repair path
+#include "transfer.h"
+
+// symbols in esi order with random loss. blocks decoded on arrival must
+// complete inside nanorq_decoder_add_symbol, the others get repaired once
+// they hold K symbols
+static void round_trip(size_t len, uint16_t T, uint16_t Z, double loss,
+                       uint32_t inc_max, bool on_arrival, unsigned seed) {
+  transfer x;
+  transfer_open(&x, len, T, Z, inc_max, 2, seed);
+  for (uint8_t sbn = 0; sbn < nanorq_blocks(x.enc); sbn++) {
+    size_t K = nanorq_block_symbols(x.enc, sbn), got = 0;
+    for (uint32_t esi = 0; esi < 65535; esi++) {
+      if ((double)rand() / RAND_MAX < loss)
+        continue;
+      if (transfer_add(&x, sbn, esi) == NANORQ_SYM_ADDED)
+        got++;
+      if (nanorq_num_missing(x.dec, sbn) == 0)
+        break;
+      if (!on_arrival && got >= K)
+        nanorq_repair_block(x.dec, x.out, sbn);
+    }
+    CHECK(nanorq_num_missing(x.dec, sbn) == 0);
+  }
+  transfer_close(&x, true);
+}
+
+// repair symbols first, then the source symbols backwards, so late source
+// symbols land on columns that already have a pivot row
+static void late_sources(size_t K, uint16_t T, unsigned seed) {
+  transfer x;
+  transfer_open(&x, K * T, T, 1, NANORQ_INC_MAX_KPRIME, 2, seed);
+  size_t half = K / 2;
+  for (uint32_t esi = K; esi < K + half; esi++)
+    CHECK(transfer_add(&x, 0, esi) == NANORQ_SYM_ADDED);
+  CHECK(nanorq_num_missing(x.dec, 0) == K);
+  for (uint32_t esi = K - 1; nanorq_num_missing(x.dec, 0) > 0; esi--)
+    CHECK(transfer_add(&x, 0, esi) == NANORQ_SYM_ADDED);
+  // the block finished with about half of its source symbols in
+  CHECK(nanorq_num_missing(x.dec, 0) == 0);
+  CHECK(transfer_add(&x, 0, 0) == NANORQ_SYM_IGN);
+  CHECK(!nanorq_set_incremental_max(x.dec, 0));
+  transfer_close(&x, true);
+}
+
+int main(void) {
+  size_t lens[] = {1, 1000, 30000, 120000};
+  uint16_t Ts[] = {114, 42};
+  for (int li = 0; li < 4; li++) {
+    for (int ti = 0; ti < 2; ti++) {
+      unsigned seed = li * 10 + ti;
+      // every block of these is well below the default limit
+      round_trip(lens[li], Ts[ti], 0, 0.0, NANORQ_INC_MAX_KPRIME, true, seed);
+      round_trip(lens[li], Ts[ti], 0, 0.3, NANORQ_INC_MAX_KPRIME, true, seed);
+      round_trip(lens[li], Ts[ti], 0, 0.3, 0, false, seed);
+    }
+  }
+  // one block above the default limit, with the limit raised and as is
+  round_trip(2500 * 32, 32, 1, 0.2, 4000, true, 5);
+  round_trip(2500 * 32, 32, 1, 0.2, NANORQ_INC_MAX_KPRIME, false, 5);
+  late_sources(300, 64, 1);
+  late_sources(1500, 16, 2);
+  return CHECK_DONE("test_decode");
+}
@@ -0,0 +1,111 @@
+/* frame_ring: order, full and flush handling, and a two thread run
+ *
+ * Copyright (C) 2020-2024 Rhizomatica
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ */
+
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "check.h"
+#include "frame_ring.h"
+
+#define DEPTH 4
+#define THREAD_DEPTH 64
+#define FRAMES 200000
+
+static bool push_value(frame_ring_t *ring, uint32_t v)
+{
+    uint8_t *slot = frame_ring_slot(ring);
+    if (!slot)
+        return false;
+    memcpy(slot, &v, sizeof(v));
+    frame_ring_push(ring);
+    return true;
+}
+
+static bool pop_value(frame_ring_t *ring, uint32_t *v)
+{
+    uint8_t *frame = frame_ring_peek(ring);
+    if (!frame)
+        return false;
+    memcpy(v, frame, sizeof(*v));
+    frame_ring_pop(ring);
+    return true;
+}
+
+static void *producer_main(void *arg)
+{
+    frame_ring_t *ring = (frame_ring_t *)arg;
+    for (uint32_t v = 0; v < FRAMES; v++)
+    {
+        // lets the consumer in on a single cpu
+        while (!push_value(ring, v))
+            usleep(1);
+    }
+    return NULL;
+}
+
+int main(void)
+{
+    frame_ring_t ring;
+    uint32_t v;
+
+    CHECK(frame_ring_init(&ring, DEPTH, sizeof(uint32_t)));
+    CHECK(frame_ring_peek(&ring) == NULL);
+
+    // frames come out in order, a full ring refuses more
+    for (uint32_t i = 0; i < DEPTH; i++)
+        CHECK(push_value(&ring, i));
+    CHECK(frame_ring_count(&ring) == DEPTH);
+    CHECK(!push_value(&ring, 99));
+    CHECK(!push_value(&ring, 99));
+    // polling a full ring counts once
+    CHECK(atomic_load(&ring.full_waits) == 1);
+    for (uint32_t i = 0; i < DEPTH; i++)
+        CHECK(pop_value(&ring, &v) && v == i);
+    CHECK(!pop_value(&ring, &v));
+    CHECK(atomic_load(&ring.popped) == DEPTH);
+
+    // the next time it fills up is another episode
+    for (uint32_t i = 0; i < DEPTH; i++)
+        CHECK(push_value(&ring, i));
+    CHECK(!push_value(&ring, 99));
+    CHECK(atomic_load(&ring.full_waits) == 2);
+
+    // flushed frames are never seen by the consumer
+    frame_ring_flush(&ring);
+    CHECK(frame_ring_count(&ring) == 0);
+    CHECK(!pop_value(&ring, &v));
+    CHECK(push_value(&ring, 7));
+    CHECK(pop_value(&ring, &v) && v == 7);
+    frame_ring_free(&ring);
+
+    // one producer and one consumer thread, nothing lost or reordered
+    CHECK(frame_ring_init(&ring, THREAD_DEPTH, sizeof(uint32_t)));
+    pthread_t tid;
+    pthread_create(&tid, NULL, producer_main, &ring);
+    uint32_t expect = 0;
+    while (expect < FRAMES)
+    {
+        if (!pop_value(&ring, &v))
+        {
+            usleep(1);
+            continue;
+        }
+        if (v != expect)
+        {
+            CHECK(v == expect);
+            break;
+        }
+        expect++;
+    }
+    pthread_join(tid, NULL);
+    CHECK(expect == FRAMES);
+    frame_ring_free(&ring);
+
+    return CHECK_DONE("test_frame_ring");
+}
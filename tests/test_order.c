@@ -0,0 +1,81 @@
+// the batch decoder and its progress counts with symbols arriving in random
+// order: repair symbols take free LT rows of D, source symbols whose row got
+// taken move to another one, and anything past L goes to the overhead region
+#include "transfer.h"
+
+// the counts nanorq_decoder_progress keeps against the ones seen here
+static void check_progress(nanorq *dec, uint8_t sbn, size_t sources,
+                           size_t repairs, size_t missing, size_t left) {
+  size_t s, r, m;
+  CHECK(nanorq_decoder_progress(dec, sbn, &s, &r, &m) == left);
+  CHECK(s == sources);
+  CHECK(r == repairs);
+  CHECK(m == missing);
+  CHECK(nanorq_num_missing(dec, sbn) == missing);
+  CHECK(nanorq_num_repair(dec, sbn) == repairs);
+}
+
+// every esi of each block below n arrives once in shuffled order with random
+// loss, the block is repaired whenever it holds K + extra symbols and once
+// more after the last one
+static void shuffled(size_t K, uint16_t T, uint16_t Z, double loss,
+                     size_t extra, bool full_inactivation, unsigned seed) {
+  transfer x;
+  transfer_open(&x, K * Z * T - seed % T, T, Z, 0, 2, seed);
+  nanorq *dec = x.dec;
+  nanorq_set_full_inactivation(dec, full_inactivation);
+
+  size_t blocks = nanorq_blocks(dec);
+  for (uint8_t sbn = 0; sbn < blocks; sbn++) {
+    size_t Kb = nanorq_block_symbols(dec, sbn), n = 2 * Kb + 100, got = 0;
+    size_t sources = 0, repairs = 0;
+    check_progress(dec, sbn, 0, 0, Kb, blocks - sbn);
+    uint32_t *order = malloc(n * sizeof(uint32_t));
+    for (size_t i = 0; i < n; i++)
+      order[i] = i;
+    for (size_t i = n - 1; i > 0; i--) {
+      size_t j = rand() % (i + 1);
+      uint32_t t = order[i];
+      order[i] = order[j];
+      order[j] = t;
+    }
+    bool done = false;
+    for (size_t i = 0; i < n && !done; i++) {
+      if ((double)rand() / RAND_MAX < loss)
+        continue;
+      int r = transfer_add(&x, sbn, order[i]);
+      CHECK(r == NANORQ_SYM_ADDED || r == NANORQ_SYM_IGN);
+      if (r == NANORQ_SYM_ADDED) {
+        got++;
+        if (order[i] < Kb)
+          sources++;
+        else
+          repairs++;
+      }
+      if (r == NANORQ_SYM_IGN)
+        done = nanorq_num_missing(dec, sbn) == 0;
+      else if (got >= Kb + extra)
+        done = nanorq_repair_block(dec, x.out, sbn);
+      check_progress(dec, sbn, sources, repairs, done ? 0 : Kb - sources,
+                     blocks - sbn - done);
+    }
+    if (!done)
+      done = nanorq_repair_block(dec, x.out, sbn);
+    CHECK(done);
+    check_progress(dec, sbn, sources, repairs, 0, blocks - sbn - 1);
+    free(order);
+  }
+  transfer_close(&x, true);
+}
+
+int main(void) {
+  size_t Ks[] = {300, 1500, 3000};
+  for (int k = 0; k < 3; k++)
+    for (unsigned s = 0; s < 3; s++)
+      shuffled(Ks[k], 64, 2, s * 0.15, s, false, 10 * k + s);
+  shuffled(1000, 32, 1, 0.3, 1, true, 40);
+  // nothing repaired before every symbol is in, which fills the overhead
+  // region well past L
+  shuffled(500, 16, 1, 0.2, 1000, false, 50);
+  return CHECK_DONE("test_order");
+}
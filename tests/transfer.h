@@ -0,0 +1,61 @@
+#ifndef TESTS_TRANSFER_H
+#define TESTS_TRANSFER_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "check.h"
+#include "nanorq.h"
+
+// random source data, an encoder over it and a decoder writing to dst
+typedef struct {
+  size_t len;
+  uint16_t T;
+  uint8_t *src, *dst;
+  struct ioctx *in, *out;
+  nanorq *enc, *dec;
+} transfer;
+
+// Z = 0 lets the encoder pick the number of blocks. the decoder decodes
+// blocks up to inc_max on arrival, the encoder runs on threads
+static void transfer_open(transfer *x, size_t len, uint16_t T, uint16_t Z,
+                          uint32_t inc_max, unsigned threads, unsigned seed) {
+  srand(seed);
+  x->len = len;
+  x->T = T;
+  x->src = malloc(len);
+  x->dst = calloc(1, len);
+  for (size_t i = 0; i < len; i++)
+    x->src[i] = rand();
+  x->in = ioctx_from_mem(x->src, len);
+  x->out = ioctx_from_mem(x->dst, len);
+  x->enc = nanorq_encoder_new_ex(len, T, 0, Z, 1);
+  CHECK(nanorq_generate_all_symbols(x->enc, x->in, threads));
+  x->dec = nanorq_decoder_new(nanorq_oti_common(x->enc),
+                              nanorq_oti_scheme_specific(x->enc));
+  nanorq_set_max_esi(x->dec, 65535);
+  CHECK(nanorq_set_incremental_max(x->dec, inc_max));
+}
+
+// encodes esi of sbn and returns what adding it to the decoder gave
+static int transfer_add(transfer *x, uint8_t sbn, uint32_t esi) {
+  uint8_t sym[x->T];
+  CHECK(nanorq_encode(x->enc, sym, esi, sbn, x->in) == x->T);
+  return nanorq_decoder_add_symbol(x->dec, sym, nanorq_tag(sbn, esi), x->out);
+}
+
+// with verify set, every block must be complete and dst equal src
+static void transfer_close(transfer *x, bool verify) {
+  if (verify) {
+    CHECK(nanorq_decoder_progress(x->dec, 0, NULL, NULL, NULL) == 0);
+    CHECK(memcmp(x->src, x->dst, x->len) == 0);
+  }
+  nanorq_free(x->enc);
+  nanorq_free(x->dec);
+  x->in->destroy(x->in);
+  x->out->destroy(x->out);
+  free(x->src);
+  free(x->dst);
+}
+
+#endif
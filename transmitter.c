@@ -22,9 +22,12 @@
 #include "tcp_interface.h"
 
 #include <nanorq.h>
+#include <oblas.h>
 
 
 #define MAX_ESI 65535
+// symbols encoded per block ahead of the modem feed
+#define TX_BATCH 32
 
 bool running;
 
@@ -47,70 +50,99 @@ void exit_system(int sig)
     running = false;
 }
 
-void write_esi(nanorq *rq, struct ioctx *myio, uint8_t sbn,
+void write_esi(uint8_t *data, size_t packet_size, uint8_t sbn,
               uint32_t esi, cbuf_handle_t buffer, output_mode_t out_mode)
 {
-    size_t packet_size = nanorq_symbol_size(rq);
-    uint8_t data[packet_size + RQ_HEADER_SIZE];
-    memset(data, 0, packet_size);
-    uint64_t written = nanorq_encode(rq, (void *)data, esi, sbn, myio);
+    // add our reduced tag in front of the already encoded symbol
+    nanorq_tag_reduced(sbn, esi, data+1); // 3 bytes
 
-    if (written != packet_size)
+    // set payload packet type
+    data[0] = (PACKET_RQ_PAYLOAD << 6) & 0xff;
+    data[0] |= crc6_0X6F(1, data+1, packet_size + TAG_SIZE);
+
+    if (out_mode == OUTPUT_SHM)
     {
-        fprintf(stdout, "failed to encode packet data for sbn %d esi %d.", sbn, esi);
-        abort();
+        write_buffer(buffer, data, packet_size + RQ_HEADER_SIZE);
     }
-    else
+    else // OUTPUT_TCP
     {
-        memmove (data + RQ_HEADER_SIZE, data, packet_size);
-        // add our reduced tag
-        nanorq_tag_reduced(sbn, esi, data+1); // 3 bytes
+        tcp_interface_send_kiss(&tcp_iface, data, packet_size + RQ_HEADER_SIZE);
+    }
+    tx_payload_packets++;
+    if ((tx_payload_packets % 100) == 0)
+    {
+        fprintf(stderr, "\n[DBG TX] payload_sent=%llu config_sent=%llu\n",
+                (unsigned long long)tx_payload_packets,
+                (unsigned long long)tx_config_packets);
+    }
+    fprintf(stdout, "\rBlock: %2d  Tx: %3d",  sbn, esi);
+    fflush(stdout);
+    // for (int i = 0; i < packet_size + RQ_HEADER_SIZE; i++)
+    //    printf("%02x ", data[i]);
+    // printf("\n");
+}
 
-        // set payload packet type
-        data[0] = (PACKET_RQ_PAYLOAD << 6) & 0xff;
-        data[0] |= crc6_0X6F(1, data+1, packet_size + TAG_SIZE);
+// encode the next (up to) TX_BATCH ESIs of every block with one nanorq call
+// per block, frame r * num_sbn + sbn holds ESI esi[sbn] + r of block sbn
+// returns the number of rounds encoded, 0 once the ESI space is used up
+int encode_block_rounds(nanorq *rq, struct ioctx *myio, uint32_t *esi, uint8_t *frames)
+{
+    int num_sbn = nanorq_blocks(rq);
+    size_t packet_size = nanorq_symbol_size(rq);
+    size_t frame_len = packet_size + RQ_HEADER_SIZE;
 
-        if (out_mode == OUTPUT_SHM)
-        {
-            write_buffer(buffer, data, packet_size + RQ_HEADER_SIZE);
-        }
-        else // OUTPUT_TCP
+    // blocks advance in lock step, so esi[0] bounds every block
+    if (esi[0] > MAX_ESI)
+        return 0;
+    uint32_t rounds = TX_BATCH;
+    if (esi[0] + rounds > MAX_ESI + 1)
+        rounds = MAX_ESI + 1 - esi[0];
+
+    // only source symbols of blocks still inverting in the background
+    for (int sbn = 0; sbn < num_sbn; sbn++)
+    {
+        uint32_t K = nanorq_block_symbols(rq, sbn);
+        if (nanorq_block_ready(rq, sbn) || esi[0] + rounds <= K)
+            continue;
+        rounds = (esi[0] < K) ? K - esi[0] : 0;
+    }
+    if (rounds == 0)
+    {
+        if (!nanorq_generate_wait(rq))
         {
-            tcp_interface_send_kiss(&tcp_iface, data, packet_size + RQ_HEADER_SIZE);
+            fprintf(stdout, "Could not generate RaptorQ symbols.\n");
+            return 0;
         }
-        tx_payload_packets++;
-        if ((tx_payload_packets % 100) == 0)
+        return encode_block_rounds(rq, myio, esi, frames);
+    }
+
+    memset(frames, 0, rounds * num_sbn * frame_len);
+    for (int sbn = 0; sbn < num_sbn; sbn++)
+    {
+        size_t written = nanorq_encode_batch(rq, sbn, esi[sbn], rounds,
+                                             frames + sbn * frame_len + RQ_HEADER_SIZE,
+                                             num_sbn * frame_len, myio);
+        if (written != rounds)
         {
-            fprintf(stderr, "\n[DBG TX] payload_sent=%llu config_sent=%llu\n",
-                    (unsigned long long)tx_payload_packets,
-                    (unsigned long long)tx_config_packets);
+            fprintf(stdout, "failed to encode packet data for sbn %d esi %d.", sbn, esi[sbn] + (int) written);
+            abort();
         }
-        fprintf(stdout, "\rBlock: %2d  Tx: %3d",  sbn, esi);
-        fflush(stdout);
-        // for (int i = 0; i < packet_size + RQ_HEADER_SIZE; i++)
-        //    printf("%02x ", data[i]);
-        // printf("\n");
     }
+    return rounds;
 }
 
-bool write_interleaved_block_packets(nanorq *rq, struct ioctx *myio, uint32_t *esi, cbuf_handle_t buffer, output_mode_t out_mode)
+void write_interleaved_block_packets(nanorq *rq, uint8_t *frames, uint32_t *esi, cbuf_handle_t buffer, output_mode_t out_mode)
 {
     int num_sbn = nanorq_blocks(rq);
+    size_t packet_size = nanorq_symbol_size(rq);
 
     // for all blocks TODO: shuffle the sbn traversal each call
     for (int sbn = 0; sbn < num_sbn && running; sbn++)
     {
-        write_esi(rq, myio, sbn, esi[sbn], buffer, out_mode);
+        write_esi(frames + sbn * (packet_size + RQ_HEADER_SIZE), packet_size,
+                  sbn, esi[sbn], buffer, out_mode);
         esi[sbn]++;
-//        if (esi[sbn] > ((1 << 24) - 1))
-        if (esi[sbn] > ((1 << 16) - 1))
-        {
-            // printf("ESI LIMIT REACHED, PLEASE INCREASE-ME BACK TO 24 BITS!\n");
-            return false;
-            // esi[sbn] = 0;
-        }
     }
-    return true;
 }
 
 void write_configuration_packet(int packet_size, cbuf_handle_t buffer, output_mode_t out_mode)
@@ -150,6 +182,7 @@ void print_usage(const char *prog_name)
     printf("  -t, --tcp         Use TCP output to hermes-modem (default: shared memory)\n");
     printf("  -i, --ip IP       IP address of hermes-modem (default: %s)\n", DEFAULT_MODEM_IP);
     printf("  -p, --port PORT   TCP port of hermes-modem (default: %d)\n", DEFAULT_MODEM_PORT);
+    printf("  -T, --threads N   Encoder threads (default: number of CPUs)\n");
     printf("  -h, --help        Show this help message\n");
     printf("\nModulation modes:\n");
     printf("  Shared memory (Mercury): 0-16\n");
@@ -168,18 +201,20 @@ int main(int argc, char *argv[]) {
     output_mode_t out_mode = OUTPUT_SHM;
     char *tcp_ip = DEFAULT_MODEM_IP;
     int tcp_port = DEFAULT_MODEM_PORT;
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
 
     static struct option long_options[] = {
-        {"tcp",  no_argument,       0, 't'},
-        {"ip",   required_argument, 0, 'i'},
-        {"port", required_argument, 0, 'p'},
-        {"help", no_argument,       0, 'h'},
+        {"tcp",     no_argument,       0, 't'},
+        {"ip",      required_argument, 0, 'i'},
+        {"port",    required_argument, 0, 'p'},
+        {"threads", required_argument, 0, 'T'},
+        {"help",    no_argument,       0, 'h'},
         {0, 0, 0, 0}
     };
 
     int opt;
     int option_index = 0;
-    while ((opt = getopt_long(argc, argv, "ti:p:h", long_options, &option_index)) != -1)
+    while ((opt = getopt_long(argc, argv, "ti:p:T:h", long_options, &option_index)) != -1)
     {
         switch (opt)
         {
@@ -192,6 +227,9 @@ int main(int argc, char *argv[]) {
         case 'p':
             tcp_port = atoi(optarg);
             break;
+        case 'T':
+            threads = atoi(optarg);
+            break;
         case 'h':
             print_usage(argv[0]);
             return 0;
@@ -221,7 +259,8 @@ int main(int argc, char *argv[]) {
         return -1;
     }
 
-    struct ioctx *myio = ioctx_from_file(infile, 1);
+    // map the input, systematic symbols are copied straight out of it
+    struct ioctx *myio = ioctx_mmap_file(infile, 1);
     if (!myio)
     {
         fprintf(stdout, "couldnt access file %s\n", infile);
@@ -240,7 +279,7 @@ int main(int argc, char *argv[]) {
     uint32_t frame_size = frame_sizes[mod_mode];
     size_t packet_size = frame_size - (uint32_t) RQ_HEADER_SIZE; // T
 
-    printf("Mode: %d, Frame size: %u bytes, Packet size: %zu bytes\n", mod_mode, frame_size, packet_size);
+    printf("Mode: %d, Frame size: %u bytes, Packet size: %zu bytes, oblas: %s\n", mod_mode, frame_size, packet_size, oblas_backend());
 
     running = true;
     signal(SIGQUIT, exit_system);
@@ -271,10 +310,18 @@ int main(int argc, char *argv[]) {
     printf("\e[?25l"); // hide cursor
     printf("RaptorQ init: Blocks: %d  Packet_size: %lu\n", num_sbn, packet_size);
 
-    for (int b = 0; b < num_sbn; b++)
+    if (threads < 1)
+        threads = 1;
+
+    // source symbols go on air right away, blocks invert in the background
+    if (!nanorq_generate_async(rq, myio, (unsigned) threads))
     {
-        nanorq_generate_symbols(rq, b, myio);
+        fprintf(stdout, "Could not load RaptorQ source blocks.\n");
+        nanorq_free(rq);
+        myio->destroy(myio);
+        return -1;
     }
+    printf("RaptorQ symbol memory: %zu KiB\n", nanorq_peak_memory(rq) / 1024);
 
     memset(configuration_packet, 0, CONFIG_PACKET_SIZE);
 
@@ -312,14 +359,38 @@ int main(int argc, char *argv[]) {
         printf("Output mode: Shared memory\n");
     }
 
+    size_t frame_len = packet_size + RQ_HEADER_SIZE;
+    uint8_t *frames = malloc(TX_BATCH * num_sbn * frame_len);
+    if (frames == NULL)
+    {
+        fprintf(stderr, "Failed to allocate %zu bytes of frame buffer\n", (size_t) TX_BATCH * num_sbn * frame_len);
+        nanorq_free(rq);
+        myio->destroy(myio);
+        if (out_mode == OUTPUT_TCP)
+            tcp_interface_disconnect(&tcp_iface);
+        else
+            circular_buf_free_shm(buffer);
+        return -1;
+    }
+    int rounds = 0, round = 0;
+
     while(running)
     {
+        if (round == rounds)
+        {
+            rounds = encode_block_rounds(rq, myio, esi, frames);
+            round = 0;
+            if (rounds == 0)
+                break;
+        }
+
         // 1 configuration packet per each sbn "slice"
         write_configuration_packet(frame_size, buffer, out_mode);
 
-        if (write_interleaved_block_packets(rq, myio, esi, buffer, out_mode) == false)
-            running = false;
+        write_interleaved_block_packets(rq, frames + round * num_sbn * frame_len, esi, buffer, out_mode);
+        round++;
     }
+    free(frames);
 
     printf("\nshutdown.\n");
     printf("\e[?25h"); // re-enable cursor